@@ -0,0 +1,115 @@
+/*
+ * Distance policies for ranking restaurants by how far they are from the
+ * cursor.  Each is a struct with a dist_t type and a static dist()
+ * taking two points in full size map pixels; code templated on a policy
+ * calls it directly, so the choice costs nothing at run time.
+ *
+ * ManhattanDistance : |dx| + |dy| in map pixels
+ * EuclideanDistance : dx^2 + dy^2 in map pixels, exact
+ * EquirectDistance  : metres on the ground, from the latitude and
+ *                     longitude the pixels stand for
+ */
+
+#ifndef _DISTANCE_H
+#define _DISTANCE_H
+
+#include <stdint.h>
+
+/* The map the pixels are on, in hundred-thousandths of a degree; must
+ * match MAP_WIDTH, MAP_HEIGHT and LAT_NORTH etc. in restfind.h, which
+ * checks that they do.
+ */
+#define DIST_MAP_SIZE 2048
+#define DIST_LAT_SPAN 20905l
+#define DIST_LON_SPAN 35156l
+
+/* Metres in a hundred-thousandth of a degree of latitude, and of
+ * longitude at the latitude of the middle of the map (53.514 N), as
+ * 16.16 fixed point.  Treating the longitude scale as the same over the
+ * whole city is the equirectangular approximation; east-west distances
+ * are off by up to 0.25% at the top and bottom edges of the map.
+ */
+#define DIST_LAT_METRES_Q16 72873ul
+#define DIST_LON_METRES_Q16 43332ul
+
+/* Absolute difference of two coordinates, which needs 17 bits.
+ */
+static inline uint32_t dist_delta(int16_t a, int16_t b) {
+  return a > b ? (int32_t) a - b : (int32_t) b - a;
+}
+
+/* Integer square root, rounded down.
+ */
+static inline uint16_t dist_sqrt(uint32_t n) {
+  uint32_t root = 0;
+  uint32_t bit = 1ul << 30;
+  while (bit > n) {
+    bit >>= 2;
+  }
+  while (bit != 0) {
+    if (n >= root + bit) {
+      n -= root + bit;
+      root = (root >> 1) + bit;
+    }
+    else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return root;
+}
+
+/* Sum of the differences along each axis.  Saturates at 65535 instead of
+ * wrapping, for restaurants far off the map.
+ */
+struct ManhattanDistance {
+  typedef uint16_t dist_t;
+  static const char* name() { return "manhattan"; }
+
+  static inline dist_t dist(int16_t x1, int16_t y1, int16_t x2, int16_t y2) {
+    uint32_t d = dist_delta(x1, x2) + dist_delta(y1, y2);
+    return d > 0xFFFF ? 0xFFFF : d;
+  }
+};
+
+/* Square of the straight line distance, which ranks the same as the
+ * distance itself without a square root.  Exact while neither difference
+ * exceeds 46340 pixels, saturating beyond.  Takes 32 bits, so a RestDist
+ * holding one is two bytes bigger.
+ */
+struct EuclideanDistance {
+  typedef uint32_t dist_t;
+  static const char* name() { return "euclidean"; }
+
+  static inline dist_t dist(int16_t x1, int16_t y1, int16_t x2, int16_t y2) {
+    uint32_t dx = dist_delta(x1, x2), dy = dist_delta(y1, y2);
+    if (dx > 46340 || dy > 46340 || dx*dx > 0xFFFFFFFFul - dy*dy) {
+      return 0xFFFFFFFFul;
+    }
+    return dx*dx + dy*dy;
+  }
+};
+
+/* Distance on the ground in metres.  The pixel differences are turned
+ * back into differences of latitude and longitude, scaled to metres
+ * north and east, and combined as on a flat plane.  Points more than a
+ * map width apart along either axis are all 65535 m away.
+ */
+struct EquirectDistance {
+  typedef uint16_t dist_t;
+  static const char* name() { return "equirect"; }
+
+  static inline dist_t dist(int16_t x1, int16_t y1, int16_t x2, int16_t y2) {
+    uint32_t dx = dist_delta(x1, x2), dy = dist_delta(y1, y2);
+    if (dx > DIST_MAP_SIZE || dy > DIST_MAP_SIZE) {
+      return 0xFFFF;
+    }
+    uint32_t dLon = dx * DIST_LON_SPAN / DIST_MAP_SIZE;
+    uint32_t dLat = dy * DIST_LAT_SPAN / DIST_MAP_SIZE;
+    uint32_t east = dLon * DIST_LON_METRES_Q16 >> 16;
+    uint32_t north = dLat * DIST_LAT_METRES_Q16 >> 16;
+    return dist_sqrt(east*east + north*north);
+  }
+};
+
+#endif
@@ -0,0 +1,159 @@
+/*
+ * An on-screen display of how the sketch is performing.
+ */
+
+#include <Arduino.h>
+#include "MCUFRIEND_kbv.h"
+
+#include "hud.h"
+#include "lcd_image.h"
+#include "perf.h"
+
+#ifdef PERF_HUD
+
+#define SD_BLOCK_SIZE 512
+
+// the text of each line, worked out at the end of the last period, and
+// what is on screen now; a space is nothing drawn
+static char text[HUD_LINES][HUD_COLS];
+static char shown[HUD_LINES][HUD_COLS];
+static bool started = false;
+
+// when the period started and the totals then
+static uint32_t period_start;
+static uint32_t start_blocks, start_hits;
+
+// the end of the last pass of a mode loop, the longest pass in the
+// period, and the last ranking; passes are timed from the first
+// hud_draw(), not from power on
+static uint32_t pass_end = 0;
+static uint32_t worst_pass = 0;
+static int32_t rank_ms = -1;
+
+/* Bytes of SRAM between the top of the heap and the stack, or 0 off the
+ * unit, where there is no such gap to measure.
+ */
+static uint16_t free_sram() {
+#ifdef __AVR__
+  extern char __heap_start, *__brkval;
+  char top;
+  return &top - (__brkval != NULL ? __brkval : &__heap_start);
+#else
+  return 0;
+#endif
+}
+
+/* Block reads of the map and the restaurants so far, and how many of
+ * them the block already held served.
+ */
+static uint32_t total_blocks() {
+  return lcd_image_stats.blocks + perf.rest_blocks + perf.index_blocks;
+}
+
+static uint32_t total_hits() {
+  return lcd_image_stats.hits + (perf.rest_reads - perf.rest_blocks);
+}
+
+/* Writes label, value and unit into line, the value right aligned
+ * before the unit; a negative value is shown as "-" and one too long for
+ * the line as nines.
+ */
+static void format_line(char *line, const char *label, int32_t value,
+                        const char *unit)
+{
+  uint8_t label_len = strlen(label);
+  uint8_t end = HUD_COLS - strlen(unit);
+  memset(line, ' ', HUD_COLS);
+  memcpy(line, label, label_len);
+  memcpy(line + end, unit, HUD_COLS - end);
+  if (value < 0) {
+    line[end - 1] = '-';
+    return;
+  }
+
+  // one space is kept after the label
+  int32_t most = 1;
+  for (uint8_t i = label_len + 1; i < end; i++) {
+    most *= 10;
+  }
+  value = min(value, most - 1);
+  do {
+    line[--end] = '0' + value % 10;
+    value /= 10;
+  } while (value > 0);
+}
+
+/* Works out the figures of the period that ended at now and starts the
+ * next one.
+ */
+static void end_period(uint32_t now) {
+  uint32_t blocks = total_blocks() - start_blocks;
+  uint32_t hits = total_hits() - start_hits;
+  int32_t hit_rate = blocks + hits > 0 ? hits * 100 / (blocks + hits) : -1;
+
+  format_line(text[0], "fr", worst_pass, "ms");
+  format_line(text[1], "sd", blocks * SD_BLOCK_SIZE / 1024, "KB");
+  format_line(text[2], "hit", hit_rate, "%");
+  format_line(text[3], "ram", free_sram(), "B");
+  format_line(text[4], "rk", rank_ms, "ms");
+
+  period_start = now;
+  start_blocks = total_blocks();
+  start_hits = total_hits();
+  worst_pass = 0;
+}
+
+#endif
+
+void hud_frame() {
+#ifdef PERF_HUD
+  uint32_t now = millis();
+  worst_pass = max(worst_pass, now - pass_end);
+  pass_end = now;
+#endif
+}
+
+void hud_rank(uint32_t ms) {
+#ifdef PERF_HUD
+  rank_ms = ms;
+#endif
+}
+
+void hud_reset() {
+#ifdef PERF_HUD
+  memset(shown, ' ', sizeof(shown));
+#endif
+}
+
+void hud_draw(MCUFRIEND_kbv *tft, int16_t x, int16_t y) {
+#ifdef PERF_HUD
+  uint32_t now = millis();
+  if (!started) {
+    memset(text, ' ', sizeof(text));
+    period_start = now;
+    start_blocks = total_blocks();
+    start_hits = total_hits();
+    pass_end = now;
+    worst_pass = 0;
+    started = true;
+  }
+  if (now - period_start >= HUD_PERIOD_MS) {
+    end_period(now);
+  }
+
+  tft->setTextSize(1);
+  tft->setTextColor(TFT_WHITE, TFT_BLACK);
+  for (uint8_t line = 0; line < HUD_LINES; line++) {
+    for (uint8_t col = 0; col < HUD_COLS; col++) {
+      char c = text[line][col];
+      if (c == shown[line][col]) {
+        continue;
+      }
+      tft->setCursor(x + 6*col, y + HUD_LINE_HEIGHT*line);
+      perf.chars += tft->print(c);
+      shown[line][col] = c;
+    }
+  }
+  tft->setTextSize(SKETCH_TEXT_SIZE);
+#endif
+}
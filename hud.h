@@ -0,0 +1,56 @@
+/*
+ * An on-screen display of how the sketch is performing, for units that
+ * cannot be watched over Serial.  Built with -DPERF_HUD it shows, in a
+ * few lines of the sidebar:
+ *
+ *   fr  : the longest pass of a mode loop in the last period, in ms
+ *   sd  : KB read from the card in the last period, map and restaurants
+ *   hit : the share of block reads the last block read already held
+ *   ram : bytes of SRAM free between the heap and the stack
+ *   rk  : how long the last nearest list took to rank, in ms
+ *
+ * The figures come from the counters of lcd_image.h and perf.h, which
+ * lcd_image_draw() and getRestaurant() keep, and from the calls below
+ * made by the mode loops.  Only the characters that changed are drawn,
+ * so the display costs little of what it measures.  Without -DPERF_HUD
+ * every function here does nothing.
+ */
+
+#ifndef _HUD_H
+#define _HUD_H
+
+#include "MCUFRIEND_kbv.h"
+
+// lines shown, the characters of each and the pixels from one to the next
+#define HUD_LINES 5
+#define HUD_COLS 9
+#define HUD_LINE_HEIGHT 10
+
+// the figures are worked out once every period, in ms
+#define HUD_PERIOD_MS 1000
+
+// the text size the sketch sets at power on and everything else drawing
+// smaller text, the HUD included, puts back
+#define SKETCH_TEXT_SIZE 2
+
+/* Marks the end of one pass of a mode loop, timing it from the end of
+ * the one before.
+ */
+void hud_frame();
+
+/* Records how long the last nearest list took to rank, in ms.
+ */
+void hud_rank(uint32_t ms);
+
+/* Has the next hud_draw() draw every line, once the area it draws in
+ * has been cleared to black.
+ */
+void hud_reset();
+
+/* Works out the figures once every HUD_PERIOD_MS, and draws the
+ * characters that differ from what is on screen with their top left
+ * corner at x, y.
+ */
+void hud_draw(MCUFRIEND_kbv *tft, int16_t x, int16_t y);
+
+#endif
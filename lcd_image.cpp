@@ -8,6 +8,336 @@
 #include <SD.h>
 
 #include "lcd_image.h"
+#include "scratch.h"
+#include "sdread.h"
+
+#define SD_BLOCK_SIZE 512
+
+// bytes in one run of an LCD_TILED_RLE tile
+#define RLE_RUN_SIZE 3
+// runs and tile offsets fetched from the card per read of an LCD_TILED_RLE image
+#define RLE_CHUNK 16
+
+// pixels widened at a time when drawing scaled up
+#define SCALE_CHUNK 64
+
+// pixels of a row-major row sent at a time, the width of the sketch's
+// map area; wider rows are drawn in pieces, and rows scaled up in pieces
+// that are as wide once scaled, at most half as many pixels read
+#define ROW_CHUNK 420
+
+// the deepest a draw goes into the scratch arena: a row piece, or a
+// scaled one or a tile and its runs with the widened pixels of out_row()
+SCRATCH_ASSERT_FITS(ROW_CHUNK * 2);
+SCRATCH_ASSERT_FITS((ROW_CHUNK / 2) * 2 + SCALE_CHUNK * 2);
+SCRATCH_ASSERT_FITS(LCD_TILE_SIZE * LCD_TILE_SIZE * 2 + SCALE_CHUNK * 2);
+
+// rows drawn per step of a progressive draw, one tile band
+#define PROGRESS_ROWS LCD_TILE_SIZE
+
+// mid grey, filled in for pixels that could not be read from the card
+#define PLACEHOLDER_COLOUR 0x8410
+
+lcd_image_stats_t lcd_image_stats;
+
+// block and file position following the most recent read, used to tell
+// buffered blocks and sequential reads apart from fresh ones
+static uint32_t last_block = 0xFFFFFFFF;
+static uint32_t next_pos = 0xFFFFFFFF;
+
+// where the patch being drawn goes on the screen, and log2 of the factor
+// it is scaled up by; the readers below work in patch coordinates and
+// leave placing and scaling to out_window(), out_row() and out_fill()
+static uint16_t out_scol, out_srow;
+static uint8_t out_shift;
+static bool out_first;
+
+/* Reads len bytes at file offset pos into buf, seeking only if the read
+ * does not continue the previous one, and updates lcd_image_stats.
+ *
+ * Returns true if all len bytes were read; the caller draws a placeholder
+ * otherwise.
+ */
+static bool read_at(File &file, uint32_t pos, uint8_t *buf, uint16_t len) {
+  bool seek = pos != next_pos;
+  if (seek) {
+    lcd_image_stats.seeks++;
+  }
+
+  uint32_t first = pos / SD_BLOCK_SIZE;
+  uint32_t last = (pos + len - 1) / SD_BLOCK_SIZE;
+  lcd_image_stats.blocks += last - first + (first == last_block ? 0 : 1);
+  lcd_image_stats.hits += first == last_block ? 1 : 0;
+  lcd_image_stats.bytes += len;
+  last_block = last;
+  next_pos = pos + len;
+
+  if (!sdread_file(file, pos, seek, buf, len)) {
+    // where the file and the SD library's buffer are is unknown now
+    last_block = 0xFFFFFFFF;
+    next_pos = 0xFFFFFFFF;
+    return false;
+  }
+  return true;
+}
+
+/* Swaps the bytes of n pixels in place; pixel bytes are stored on the card
+ * in the reverse order to what the display expects.
+ */
+static void swap_pixels(uint16_t *pixels, uint16_t n) {
+  for (uint16_t i = 0; i < n; i++) {
+    pixels[i] = (pixels[i] << 8) | (pixels[i] >> 8);
+  }
+}
+
+/* Sets the display window to patch pixels (x0, y0) to (x1, y1). */
+static void out_window(MCUFRIEND_kbv *tft, uint16_t x0, uint16_t y0,
+		    uint16_t x1, uint16_t y1)
+{
+  tft->setAddrWindow(out_scol + (x0 << out_shift), out_srow + (y0 << out_shift),
+                     out_scol + ((x1 + 1) << out_shift) - 1,
+                     out_srow + ((y1 + 1) << out_shift) - 1);
+  out_first = true;
+}
+
+/* Sends the next row of n pixels of the window, widening each pixel and
+ * repeating the row when scaled up.
+ */
+static void out_row(MCUFRIEND_kbv *tft, uint16_t *pixels, uint16_t n) {
+  lcd_image_stats.pixels += (uint32_t) n << (2 * out_shift);
+  if (out_shift == 0) {
+    tft->pushColors(pixels, n, out_first);
+    out_first = false;
+    return;
+  }
+
+  ScratchScope scope;
+  uint16_t *wide = scope.alloc<uint16_t>(SCALE_CHUNK);
+  uint8_t scale = 1 << out_shift;
+  for (uint8_t r = 0; r < scale; r++) {
+    uint16_t k = 0;
+    for (uint16_t i = 0; i < n; i++) {
+      for (uint8_t j = 0; j < scale; j++) {
+        wide[k++] = pixels[i];
+        if (k == SCALE_CHUNK) {
+          tft->pushColors(wide, k, out_first);
+          out_first = false;
+          k = 0;
+        }
+      }
+    }
+    if (k > 0) {
+      tft->pushColors(wide, k, out_first);
+      out_first = false;
+    }
+  }
+}
+
+/* Fills w x h patch pixels at (x, y) with one colour. */
+static void out_fill(MCUFRIEND_kbv *tft, uint16_t x, uint16_t y,
+		    uint16_t w, uint16_t h, uint16_t colour)
+{
+  lcd_image_stats.pixels += ((uint32_t) w * h) << (2 * out_shift);
+  tft->fillRect(out_scol + (x << out_shift), out_srow + (y << out_shift),
+                w << out_shift, h << out_shift, colour);
+}
+
+/* Fills w x h patch pixels at (x, y) whose image data could not be read. */
+static void out_placeholder(MCUFRIEND_kbv *tft, uint16_t x, uint16_t y,
+		    uint16_t w, uint16_t h)
+{
+  lcd_image_stats.gaps++;
+  out_fill(tft, x, y, w, h, PLACEHOLDER_COLOUR);
+}
+
+static void draw_row_major(const lcd_image_t *img, MCUFRIEND_kbv *tft, File &file,
+		    uint16_t icol, uint16_t irow,
+		    uint16_t width, uint16_t height)
+{
+  uint16_t chunk = ROW_CHUNK >> out_shift;
+  ScratchScope scope;
+  uint16_t *pixels = scope.alloc<uint16_t>(min(width, chunk));
+  for (uint16_t row=0; row < height; row++) {
+    for (uint16_t col = 0; col < width; col += chunk) {
+      uint16_t n = min(width - col, chunk);
+      // Seek to start of pixels to read from, need 32 bit arith for big images
+      uint32_t pos = ( (uint32_t) irow +  (uint32_t) row) *
+        (2 *  (uint32_t) img->ncols) +  ((uint32_t) icol + col) * 2;
+
+      // Read row of pixels
+      if (!read_at(file, pos, (uint8_t *) pixels, 2 * n)) {
+        out_placeholder(tft, col, row, n, 1);
+        continue;
+      }
+      swap_pixels(pixels, n);
+
+      tft->startWrite();
+      // Setup display to receive window of pixels
+      out_window(tft, col, row, col + n - 1, row);
+
+      // Send pixels to display
+      out_row(tft, pixels, n);
+      tft->endWrite();
+    }
+  }
+}
+
+/* Tiled images are read one whole tile (one SD block) at a time.  The
+ * tiles covering one band of tile rows are adjacent on the card, so a
+ * patch costs a single seek per band rather than one per pixel row.
+ */
+static void draw_tiled(const lcd_image_t *img, MCUFRIEND_kbv *tft, File &file,
+		    uint16_t icol, uint16_t irow,
+		    uint16_t width, uint16_t height)
+{
+  ScratchScope scope;
+  uint16_t *tile = scope.alloc<uint16_t>(LCD_TILE_SIZE * LCD_TILE_SIZE);
+  uint16_t tiles_per_row = img->ncols / LCD_TILE_SIZE;
+  uint16_t last_col = icol + width - 1;
+  uint16_t last_row = irow + height - 1;
+
+  for (uint16_t ty = irow / LCD_TILE_SIZE; ty <= last_row / LCD_TILE_SIZE; ty++) {
+    // rows of this tile band that fall inside the patch
+    uint16_t top = max(irow, ty * LCD_TILE_SIZE);
+    uint16_t bottom = min(last_row, ty * LCD_TILE_SIZE + LCD_TILE_SIZE - 1);
+
+    for (uint16_t tx = icol / LCD_TILE_SIZE; tx <= last_col / LCD_TILE_SIZE; tx++) {
+      // columns of this tile that fall inside the patch
+      uint16_t left = max(icol, tx * LCD_TILE_SIZE);
+      uint16_t right = min(last_col, tx * LCD_TILE_SIZE + LCD_TILE_SIZE - 1);
+      uint16_t w = right - left + 1;
+
+      uint32_t pos = ((uint32_t) ty * tiles_per_row + tx) * SD_BLOCK_SIZE;
+      if (!read_at(file, pos, (uint8_t *) tile, SD_BLOCK_SIZE)) {
+        out_placeholder(tft, left - icol, top - irow, w, bottom - top + 1);
+        continue;
+      }
+
+      tft->startWrite();
+      out_window(tft, left - icol, top - irow, right - icol, bottom - irow);
+      for (uint16_t y = top; y <= bottom; y++) {
+        uint16_t *pixels = tile + (y % LCD_TILE_SIZE) * LCD_TILE_SIZE
+          + left % LCD_TILE_SIZE;
+        swap_pixels(pixels, w);
+        out_row(tft, pixels, w);
+      }
+      tft->endWrite();
+    }
+  }
+}
+
+/* Decodes the len bytes of runs of one LCD_TILED_RLE tile starting at file
+ * offset pos and draws the part of the tile from local column left to right
+ * and local row top to bottom at patch position (px, py).  A tile made of
+ * a single run becomes one fill; otherwise runs are clipped to the window
+ * and each visible row is sent as soon as it is decoded.
+ */
+static bool draw_rle_tile(MCUFRIEND_kbv *tft, File &file, uint32_t pos, uint16_t len,
+		    uint16_t left, uint16_t right, uint16_t top, uint16_t bottom,
+		    uint16_t px, uint16_t py)
+{
+  ScratchScope scope;
+  uint8_t *runs = scope.alloc<uint8_t>(RLE_RUN_SIZE * RLE_CHUNK);
+  uint16_t *row = scope.alloc<uint16_t>(LCD_TILE_SIZE);
+  uint16_t p = 0;  // index within the tile of the next pixel decoded
+
+  tft->startWrite();
+  while (len > 0) {
+    uint16_t n = min(len, RLE_RUN_SIZE * RLE_CHUNK);
+    if (!read_at(file, pos, runs, n)) {
+      tft->endWrite();
+      return false;
+    }
+    pos += n;
+    len -= n;
+
+    for (uint16_t i = 0; i < n; i += RLE_RUN_SIZE) {
+      uint16_t count = runs[i] + 1;
+      // pixel bytes are stored most significant byte first
+      uint16_t colour = (runs[i+1] << 8) | runs[i+2];
+
+      if (count == LCD_TILE_SIZE * LCD_TILE_SIZE) {
+        tft->endWrite();
+        out_fill(tft, px, py, right - left + 1, bottom - top + 1, colour);
+        return true;
+      }
+      if (p == 0) {
+        out_window(tft, px, py, px + right - left, py + bottom - top);
+      }
+
+      // split the run at row ends and keep only the columns in the window
+      while (count > 0) {
+        uint16_t y = p / LCD_TILE_SIZE;
+        uint16_t x = p % LCD_TILE_SIZE;
+        uint16_t seg = min(count, LCD_TILE_SIZE - x);
+        if (y > bottom) {
+          tft->endWrite();
+          return true;
+        }
+        if (y >= top) {
+          for (uint16_t j = max(x, left); j <= min(x + seg - 1, right); j++) {
+            row[j - left] = colour;
+          }
+          if (x + seg > right && x <= right) {
+            out_row(tft, row, right - left + 1);
+          }
+        }
+        p += seg;
+        count -= seg;
+      }
+    }
+  }
+  tft->endWrite();
+  return true;
+}
+
+/* Compressed tiles are located through the offset table at the start of
+ * the file, read RLE_CHUNK tiles at a time.  Like draw_tiled() the tiles of
+ * a band are adjacent, so their runs are read sequentially.
+ */
+static void draw_tiled_rle(const lcd_image_t *img, MCUFRIEND_kbv *tft, File &file,
+		    uint16_t icol, uint16_t irow,
+		    uint16_t width, uint16_t height)
+{
+  ScratchScope scope;
+  uint32_t *offsets = scope.alloc<uint32_t>(RLE_CHUNK + 1);
+  uint16_t tiles_per_row = img->ncols / LCD_TILE_SIZE;
+  uint16_t last_col = icol + width - 1;
+  uint16_t last_row = irow + height - 1;
+  uint16_t last_tx = last_col / LCD_TILE_SIZE;
+
+  for (uint16_t ty = irow / LCD_TILE_SIZE; ty <= last_row / LCD_TILE_SIZE; ty++) {
+    uint16_t top = max(irow, ty * LCD_TILE_SIZE);
+    uint16_t bottom = min(last_row, ty * LCD_TILE_SIZE + LCD_TILE_SIZE - 1);
+
+    for (uint16_t tx0 = icol / LCD_TILE_SIZE; tx0 <= last_tx; tx0 += RLE_CHUNK) {
+      uint16_t ntiles = min(RLE_CHUNK, last_tx - tx0 + 1);
+      uint32_t index = (uint32_t) ty * tiles_per_row + tx0;
+      if (!read_at(file, index * sizeof(uint32_t), (uint8_t *) offsets,
+                   (ntiles + 1) * sizeof(uint32_t))) {
+        // without the offsets none of these tiles can be found
+        uint16_t left = max(icol, tx0 * LCD_TILE_SIZE);
+        uint16_t right = min(last_col, (tx0 + ntiles) * LCD_TILE_SIZE - 1);
+        out_placeholder(tft, left - icol, top - irow, right - left + 1,
+                        bottom - top + 1);
+        continue;
+      }
+
+      for (uint16_t i = 0; i < ntiles; i++) {
+        uint16_t tx = tx0 + i;
+        uint16_t left = max(icol, tx * LCD_TILE_SIZE);
+        uint16_t right = min(last_col, tx * LCD_TILE_SIZE + LCD_TILE_SIZE - 1);
+        if (!draw_rle_tile(tft, file, offsets[i], offsets[i+1] - offsets[i],
+                           left % LCD_TILE_SIZE, right % LCD_TILE_SIZE,
+                           top % LCD_TILE_SIZE, bottom % LCD_TILE_SIZE,
+                           left - icol, top - irow)) {
+          out_placeholder(tft, left - icol, top - irow, right - left + 1,
+                          bottom - top + 1);
+        }
+      }
+    }
+  }
+}
 
 /* Draws the referenced image to the LCD screen.
  *
@@ -21,47 +351,78 @@ void lcd_image_draw(const lcd_image_t *img, MCUFRIEND_kbv *tft,
 		    uint16_t icol, uint16_t irow,
 		    uint16_t scol, uint16_t srow,
 		    uint16_t width, uint16_t height)
+{
+  lcd_image_draw_scaled(img, tft, icol, irow, scol, srow, width, height, 0);
+}
+
+/* Draws the referenced image to the LCD screen, each image pixel as a
+ * (1 << shift) x (1 << shift) square.
+ */
+void lcd_image_draw_scaled(const lcd_image_t *img, MCUFRIEND_kbv *tft,
+		    uint16_t icol, uint16_t irow,
+		    uint16_t scol, uint16_t srow,
+		    uint16_t width, uint16_t height, uint8_t shift)
 {
   File file;
+  out_scol = scol;
+  out_srow = srow;
+  out_shift = shift;
 
   // Open requested file on SD card if not already open
   if ((file = SD.open(img->file_name)) == NULL) {
     Serial.print("File not found:'");
     Serial.print(img->file_name);
     Serial.println('\'');
-    return;  // how do we inform the caller than things went wrong?
+    out_placeholder(tft, 0, 0, width, height);
+    return;
   }
+  lcd_image_stats.opens++;
+  // a freshly opened file starts with an empty buffer at position 0
+  last_block = 0xFFFFFFFF;
+  next_pos = 0;
 
-  for (uint16_t row=0; row < height; row++) {
-    uint16_t pixels[width];
-    // Seek to start of pixels to read from, need 32 bit arith for big images
-    uint32_t pos = ( (uint32_t) irow +  (uint32_t) row) *
-      (2 *  (uint32_t) img->ncols) +  (uint32_t) icol * 2;
-    file.seek(pos);
-
-    // Read row of pixels
-    if (file.read((uint8_t *) pixels, 2 * width) != 2 * width) {
-      Serial.println("SD Card Read Error!");
-      file.close();
-      return;
-    }
-
-		tft->startWrite();
-		// Setup display to receive window of pixels
-		tft->setAddrWindow(scol, srow+row, scol+width-1, srow+row);
-
-    // Send pixels to display
-    for (uint16_t col=0; col < width; col++) {
-      uint16_t pixel = pixels[col];
+  if (img->layout == LCD_TILED) {
+    draw_tiled(img, tft, file, icol, irow, width, height);
+  } else if (img->layout == LCD_TILED_RLE) {
+    draw_tiled_rle(img, tft, file, icol, irow, width, height);
+  } else {
+    draw_row_major(img, tft, file, icol, irow, width, height);
+  }
+  file.close();
+}
 
-      // pixel bytes in reverse order on card (swap the most significant byte with the least significant byte)
-      pixel = (pixel << 8) | (pixel >> 8);
+/* Records the full resolution patch a progressive draw should end with. */
+void lcd_image_progress_start(lcd_progress_t *prog, const lcd_image_t *img,
+		    uint16_t icol, uint16_t irow,
+		    uint16_t scol, uint16_t srow,
+		    uint16_t width, uint16_t height)
+{
+  prog->img = img;
+  prog->icol = icol;
+  prog->irow = irow;
+  prog->scol = scol;
+  prog->srow = srow;
+  prog->width = width;
+  prog->height = height;
+  prog->done = 0;
+}
 
-			//tft->writePixel(scol+col, srow+row, pixel);
-      pixels[col] = pixel;
+/* Draws the remaining rows of a progressive draw a band at a time,
+ * stopping early if stop() says new input is waiting.
+ */
+bool lcd_image_progress_step(lcd_progress_t *prog, MCUFRIEND_kbv *tft,
+		    bool (*stop)())
+{
+  while (prog->done < prog->height) {
+    if (stop != NULL && stop()) {
+      return false;
     }
-    tft->pushColors(pixels, width, true);
-		tft->endWrite();
+    // end bands on tile boundaries so tiled images read whole tiles
+    uint16_t rows = PROGRESS_ROWS - (prog->irow + prog->done) % PROGRESS_ROWS;
+    rows = min(rows, prog->height - prog->done);
+    lcd_image_draw(prog->img, tft, prog->icol, prog->irow + prog->done,
+                   prog->scol, prog->srow + prog->done, prog->width, rows);
+    prog->done += rows;
   }
-  file.close();
+  return true;
 }
@@ -5,12 +5,61 @@
 #ifndef _LCD_IMAGE_H
 #define _LCD_IMAGE_H
 
+/* Side length in pixels of one tile of an LCD_TILED image.  A 16x16 tile
+ * of 16-bit pixels is exactly one 512 byte SD block.
+ */
+#define LCD_TILE_SIZE 16
+
+/* Order in which the pixels of an image are stored on the SD card.
+ *
+ * LCD_ROW_MAJOR : nrows rows of ncols pixels, top to bottom
+ * LCD_TILED     : LCD_TILE_SIZE x LCD_TILE_SIZE tiles stored row-major,
+ *                 each tile holding its pixels row-major; ncols and nrows
+ *                 must be multiples of LCD_TILE_SIZE
+ * LCD_TILED_RLE : the same tiles run-length encoded.  The file starts with
+ *                 ntiles+1 little-endian uint32 offsets, tile i occupying
+ *                 bytes [offset[i], offset[i+1]).  A tile is a list of
+ *                 3 byte runs: pixel count - 1, then the pixel as stored
+ *                 in the other layouts.  Runs continue across tile rows.
+ */
+typedef enum {
+  LCD_ROW_MAJOR = 0,
+  LCD_TILED = 1,
+  LCD_TILED_RLE = 2
+} lcd_layout_t;
+
 typedef struct {
   char file_name[50];
   uint16_t ncols;
   uint16_t nrows;
+  uint8_t layout;   // an lcd_layout_t, defaults to LCD_ROW_MAJOR
 } lcd_image_t;
 
+/* Running totals of the work done by lcd_image_draw().
+ *
+ * blocks : 512 byte SD blocks read (a block read again right after itself
+ *          is served from the SD library's buffer and not counted)
+ * hits   : reads that began in the block the previous read ended in,
+ *          served from the SD library's buffer
+ * bytes  : image bytes read
+ * seeks  : reads that did not continue where the previous read stopped
+ * opens  : image files opened
+ * pixels : pixels sent to the display, pushed or filled
+ * gaps   : parts of patches filled grey instead, their pixels not read
+ *          from the card (see sdread.h)
+ */
+typedef struct {
+  uint32_t blocks;
+  uint32_t hits;
+  uint32_t bytes;
+  uint32_t seeks;
+  uint32_t opens;
+  uint32_t pixels;
+  uint32_t gaps;
+} lcd_image_stats_t;
+
+extern lcd_image_stats_t lcd_image_stats;
+
 /* Draws the referenced image to the LCD screen.
  *
  * img           : the image to draw
@@ -24,4 +73,44 @@ void lcd_image_draw(const lcd_image_t *img, MCUFRIEND_kbv *tft,
 		    uint16_t scol, uint16_t srow,
 		    uint16_t width, uint16_t height);
 
+/* Draws the referenced image scaled up, each image pixel becoming a
+ * (1 << shift) pixel square on the screen.  Used to put a coarse pyramid
+ * level on the screen quickly while the full resolution image follows.
+ *
+ * icol, irow    : the upper-left corner of the patch, in img pixels
+ * width, height : the size of the patch in img pixels; the screen area
+ *                 covered is (width << shift) by (height << shift)
+ */
+void lcd_image_draw_scaled(const lcd_image_t *img, MCUFRIEND_kbv *tft,
+		    uint16_t icol, uint16_t irow,
+		    uint16_t scol, uint16_t srow,
+		    uint16_t width, uint16_t height, uint8_t shift);
+
+/* A full resolution draw done in bands of rows, so that it can be paused
+ * when input arrives and resumed later.
+ */
+typedef struct {
+  const lcd_image_t *img;
+  uint16_t icol, irow;
+  uint16_t scol, srow;
+  uint16_t width, height;
+  uint16_t done;   // rows drawn so far
+} lcd_progress_t;
+
+/* Sets up prog to draw the given patch; arguments as for lcd_image_draw().
+ * Nothing is drawn until lcd_image_progress_step() is called.
+ */
+void lcd_image_progress_start(lcd_progress_t *prog, const lcd_image_t *img,
+		    uint16_t icol, uint16_t irow,
+		    uint16_t scol, uint16_t srow,
+		    uint16_t width, uint16_t height);
+
+/* Continues a progressive draw.  stop, if not NULL, is called between bands
+ * and the draw pauses as soon as it returns true.
+ *
+ * Returns true once every row of the patch has been drawn.
+ */
+bool lcd_image_progress_step(lcd_progress_t *prog, MCUFRIEND_kbv *tft,
+		    bool (*stop)());
+
 #endif
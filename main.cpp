@@ -13,7 +13,13 @@
 #include <SD.h>
 #include <TouchScreen.h>
 #include <SPI.h>
+#include "hud.h"
 #include "lcd_image.h"
+#include "perf.h"
+#include "restfind.h"
+#include "scratch.h"
+#include "sdbench.h"
+#include "sdread.h"
 
 #define SD_CS 10
 
@@ -27,9 +33,10 @@
 #define YM 9  // can be a digital pin
 #define XP 8  // can be a digital pin
 
-// define constraints of cursor on screen
-#define CURSOR_X_MAX (DISPLAY_WIDTH - 60) - (CURSOR_SIZE/2) - 1
-#define CURSOR_Y_MAX DISPLAY_HEIGHT - CURSOR_SIZE/2 - 1
+// define constraints of cursor on screen, the zoomed out map levels can be
+// smaller than the display
+#define CURSOR_X_MAX (min(MAP_DISP_WIDTH, LEVEL_WIDTH) - (CURSOR_SIZE/2) - 1)
+#define CURSOR_Y_MAX (min(MAP_DISP_HEIGHT, LEVEL_HEIGHT) - CURSOR_SIZE/2 - 1)
 
 // dimensions of the part allocated to the map display
 #define MAP_DISP_WIDTH (DISPLAY_WIDTH - 60)
@@ -54,31 +61,149 @@
 #define JOYSTICK_HORIZ	A8 // A8 to VRy
 #define JOYSTICK_SEL	53 // 53 to SW
 
-// define map constants
-#define MAP_WIDTH 2048
-#define MAP_HEIGHT 2048
-#define LAT_NORTH 5361858l
-#define LAT_SOUTH 5340953l
-#define LON_WEST -11368652l
-#define LON_EAST -11333496l
+// the map's size and edges (MAP_WIDTH, LAT_NORTH etc.), the restaurant
+// structs and the conversions between map positions and lat/lon are in
+// restfind.h
+
+// number of zoom levels, level z shows the map at 1/2^z scale
+#define NUM_ZOOM_LEVELS 4
+
+// dimensions of the map at the current zoom level
+#define LEVEL_WIDTH (MAP_WIDTH >> zoom)
+#define LEVEL_HEIGHT (MAP_HEIGHT >> zoom)
 
 // define map constraints for drawing map patches
-#define YEG_X_MAX MAP_WIDTH - MAP_DISP_WIDTH
-#define YEG_Y_MAX MAP_HEIGHT - MAP_DISP_HEIGHT
+#define YEG_X_MAX max(LEVEL_WIDTH - MAP_DISP_WIDTH, 0)
+#define YEG_Y_MAX max(LEVEL_HEIGHT - MAP_DISP_HEIGHT, 0)
 
 // define middle of map for initial map patch drawn
 #define YEG_MIDDLE_X MAP_WIDTH/2 - MAP_DISP_WIDTH/2
 #define YEG_MIDDLE_Y MAP_HEIGHT/2 - MAP_DISP_HEIGHT/2
 
-// declare map
-lcd_image_t yegImage = {"yeg-big.lcd", MAP_WIDTH, MAP_HEIGHT};
+// declare map, one image per zoom level
+// build with -DYEG_TILED or -DYEG_RLE to read the tile-major or compressed
+// copies made by tools/lcdconv
+#if defined(YEG_TILED)
+#define YEG_FILE(name) name ".lct"
+#define YEG_LAYOUT LCD_TILED
+#elif defined(YEG_RLE)
+#define YEG_FILE(name) name ".lcr"
+#define YEG_LAYOUT LCD_TILED_RLE
+#else
+#define YEG_FILE(name) name ".lcd"
+#define YEG_LAYOUT LCD_ROW_MAJOR
+#endif
+lcd_image_t yegLevels[NUM_ZOOM_LEVELS] = {
+	{YEG_FILE("yeg-big"), MAP_WIDTH, MAP_HEIGHT, YEG_LAYOUT},
+	{YEG_FILE("yeg-2"), MAP_WIDTH/2, MAP_HEIGHT/2, YEG_LAYOUT},
+	{YEG_FILE("yeg-4"), MAP_WIDTH/4, MAP_HEIGHT/4, YEG_LAYOUT},
+	{YEG_FILE("yeg-8"), MAP_WIDTH/8, MAP_HEIGHT/8, YEG_LAYOUT}
+};
+
+// the sidebar right of the map holds the zoom buttons at its bottom
+#define SIDEBAR_X MAP_DISP_WIDTH
+#define SIDEBAR_WIDTH (DISPLAY_WIDTH - MAP_DISP_WIDTH)
+#define ZOOM_BTN_HEIGHT 40
+#define ZOOM_IN_Y (DISPLAY_HEIGHT - 2*ZOOM_BTN_HEIGHT)
+#define ZOOM_OUT_Y (DISPLAY_HEIGHT - ZOOM_BTN_HEIGHT)
+// the rating filter button sits above the zoom buttons, and the search
+// button above that
+#define RATING_BTN_Y (ZOOM_IN_Y - ZOOM_BTN_HEIGHT)
+#define SEARCH_BTN_Y (RATING_BTN_Y - ZOOM_BTN_HEIGHT)
+#define MAX_RATING 10
+
+// the top of the sidebar holds a minimap, a MINIMAP_SIZE square
+// thumbnail of the whole map made by tools/lcdconv thumb, with the part
+// on screen outlined in MINIMAP_COLOUR
+#define MINIMAP_FILE "yeg-mini.lcd"
+#define MINIMAP_SIZE 56
+#define MINIMAP_X (SIDEBAR_X + (SIDEBAR_WIDTH - MINIMAP_SIZE)/2)
+#define MINIMAP_Y 2
+#define MINIMAP_COLOUR TFT_RED
+
+// with -DPERF_HUD the figures of hud.h are shown below the minimap
+#define HUD_X (SIDEBAR_X + 3)
+#define HUD_Y (MINIMAP_Y + MINIMAP_SIZE + 6)
+
+// sorted index of restaurant names on the card, built by
+// tools/nameindex (see there for the layout)
+#define NAME_INDEX_FILE "names.idx"
+#define NAME_KEY_LEN 14
+#define NAME_ENTRY_SIZE 16
+#define NAME_LEAF_ENTRIES 32
+#define NAME_HEADER_SIZE 4
+#define SD_BLOCK_SIZE 512
+
+// search mode screen: the query on the top line, up to SEARCH_RESULTS
+// matches below it, and a keyboard of KEY_ROWS rows of KEY_COLS keys at
+// the bottom; the last row holds space, delete and exit
+#define SEARCH_RESULTS 8
+#define RESULTS_Y 24
+#define KEY_COLS 10
+#define KEY_ROWS 5
+#define KEY_WIDTH (DISPLAY_WIDTH / KEY_COLS)
+#define KEY_HEIGHT 32
+#define KEYBOARD_Y (DISPLAY_HEIGHT - KEY_ROWS*KEY_HEIGHT)
+#define KEY_SPACE ' '
+#define KEY_DELETE '<'
+#define KEY_EXIT '!'
+const char keyboardKeys[KEY_ROWS*KEY_COLS + 1] PROGMEM =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789'&.-    <<<!!!";
+
+// the keys that show a word instead of their character
+struct KeyLabel {
+	char key;
+	char label[6];
+};
+const KeyLabel keyLabels[] PROGMEM = {
+	{KEY_SPACE, "Space"}, {KEY_DELETE, "Del"}, {KEY_EXIT, "Exit"}
+};
+
+// spacing of the grid used to thin out restaurant dots when zoomed out,
+// at most one dot is drawn per cell
+#define DOT_CELL 8
+#define DOT_CELLS_X (MAP_DISP_WIDTH/DOT_CELL + 1)
+#define DOT_CELLS_Y (MAP_DISP_HEIGHT/DOT_CELL + 1)
+
+// restaurants are also counted in CLUSTER_CELL squares of the screen; a
+// square holding CLUSTER_MIN or more gets one marker showing the count
+// instead of its dots
+#define CLUSTER_CELL 32
+#define CLUSTER_COLS ((MAP_DISP_WIDTH + CLUSTER_CELL - 1) / CLUSTER_CELL)
+#define CLUSTER_ROWS ((MAP_DISP_HEIGHT + CLUSTER_CELL - 1) / CLUSTER_CELL)
+#define CLUSTER_MIN 4
+#define CLUSTER_RADIUS 9
+
+// the dots and markers drawn over the map are remembered, up to
+// DOT_SPRITES of them, so the map can be redrawn under them
+#define DOT_SPRITES 64
+
+// the map area waiting to be redrawn is kept as up to DIRTY_RECTS
+// rectangles, merged where they touch
+#define DIRTY_RECTS 4
+
+// a touch on the map while the dots are shown selects the nearest dot
+// within TOUCH_RADIUS pixels of it
+#define TOUCH_RADIUS 10
 
 // thresholds for the joystick
 #define JOY_CENTER   512
 #define JOY_DEADZONE 64
-#define BUFFER 400
 #define CURSOR_SIZE 9
 
+// in mode 0 the joystick is sampled every JOY_SAMPLE_MS, each sample
+// averaging JOY_OVERSAMPLE readings while the stick is pushed, and the
+// movement of all the samples in JOY_FRAME_MS is applied as one step.
+// The cursor speed runs from JOY_MIN_SPEED to JOY_MAX_SPEED pixels a
+// second along a quadratic curve of how far the stick is pushed.
+#define JOY_SAMPLE_MS 10
+#define JOY_FRAME_MS 40
+#define JOY_OVERSAMPLE 4
+#define JOY_MIN_SPEED 30
+#define JOY_MAX_SPEED 170
+// the furthest a reading gets from the edge of the dead zone
+#define JOY_RANGE (JOY_CENTER - JOY_DEADZONE - 1)
+
 MCUFRIEND_kbv tft;
 
 // a multimeter reading says there are 300 ohms of resistance across the plate,
@@ -97,39 +222,88 @@ int cursorX, cursorY;
 // used to redraw map portions over previous cursor position
 int prevX, prevY;
 
-// coordinates of current upper left corner of map
+// coordinates of current upper left corner of map at the current zoom level
 // should always be within 0 and map constraints defined above
 int yegCurrX, yegCurrY;
 
+// current zoom level, from 0 (full size) to NUM_ZOOM_LEVELS-1
+int zoom = 0;
+
 // notes that no mode switching has occurred yet
 bool firstTime = true;
 
 // notes whether the restaurant dots are drawn or not
 bool isDrawn = false;
 
+// page turns are drawn progressively: a zoom level PROGRESSIVE_STEPS
+// coarser is scaled up to fill the screen first, then the real level is
+// drawn over it in bands for as long as the joystick is left alone
+#define PROGRESSIVE_STEPS 2
+bool progressiveDraw = true;
+lcd_progress_t refine;
+bool refinePending = false;
+
+// when the current page turn started, and how long the last one took
+// to cover the screen and to finish at full resolution (ms)
+uint32_t frameStart;
+uint32_t firstFrameTime, finalFrameTime;
+
 // forward declaration for redrawing cursor
 void redrawCursor(uint16_t colour);
 
-// restaurant struct, from weekly exercise
-struct Restaurant {
-	int32_t lat; // Stored in 1/100,000 degrees
-	int32_t lon; // Stored in 1/100,000 degrees
-	uint8_t rating; // from 0 to 10
-	char name[55]; // alread null terminated in SD card
-};
+// forward declarations for the compositor
+void markDirty(int16_t x, int16_t y, int16_t w, int16_t h);
+void markCursor();
+void composeFrame();
+
+// with -DREST_TABLE the RestPos of every restaurant is kept in flash so
+// only names have to be read from the SD card
+
+#ifdef REST_TABLE
+// restTable[], the grid index cellStart[] and restByCell[] and the
+// rating index ratingStart[] and restByRating[], generated from the card's restaurant blocks by tools/restgen
+#include "rest_table.h"
+#if REST_TABLE_COUNT != NUM_RESTAURANTS
+#error "rest_table.h does not match NUM_RESTAURANTS, regenerate it"
+#endif
+#endif
+
+// set by checkRestTable() once restTable[] is known to match the card
+bool restTableValid = false;
+
+// fields of a restaurant wanted from fetchRestaurants()
+#define REST_FIELD_POS 1 // position and rating, from flash when possible
+#define REST_FIELD_NAME 2 // name, always from the SD card
+
+// called by fetchRestaurants() with each restaurant fetched, and where it
+// was in the request; name is NULL unless REST_FIELD_NAME was asked for
+typedef void (*RestDeliver)(int slot, const RestPos& pos, const char* name,
+		void* context);
+
+// the distance restaurants are ranked by, one of the policies in
+// distance.h; build with -DDIST_EUCLIDEAN or -DDIST_EQUIRECT to change it
+#if defined(DIST_EUCLIDEAN)
+typedef EuclideanDistance RestMetric;
+#elif defined(DIST_EQUIRECT)
+typedef EquirectDistance RestMetric;
+#else
+typedef ManhattanDistance RestMetric;
+#endif
 
 // restDist struct, stores index and distance from current 
 // cursor location
 // can use index to pull info from corresponding Restaurant struct
-struct RestDist {
-	uint16_t index; // index of restaurant from 0 to NUM_RESTAURANTS-1
-	uint16_t dist; // Manhattan distance to cursor position
-};
+typedef RankedRest<RestMetric> RestDist;
 
 // global variables used in mode1
 // array containing 1066 RestDist structures
 RestDist rest_dist[NUM_RESTAURANTS];
 
+// only restaurants rated at least minRating are listed and drawn;
+// restCount of them are at the start of rest_dist
+uint8_t minRating = 0;
+int restCount = NUM_RESTAURANTS;
+
 // Initialize global variables oldBlock and restBlock used in the fast method
 uint32_t oldBlock = 0;
 Restaurant restBlock[8];
@@ -137,42 +311,46 @@ Restaurant restBlock[8];
 // defines the restaurant that is currently selected
 int selectedRest = 0;
 
-// These functions convert between x/y map position and lat/lon
-int32_t x_to_lon(int16_t x) {
-	return map(x, 0, MAP_WIDTH, LON_WEST, LON_EAST);
-}
-
-int32_t y_to_lat(int16_t y) {
-	return map(y, 0, MAP_HEIGHT, LAT_NORTH, LAT_SOUTH);
+// These functions give the full size map position under the cursor,
+// whatever the current zoom level
+int16_t cursorMapX() {
+	return (yegCurrX + cursorX) << zoom;
 }
 
-int16_t lon_to_x(int32_t lon) {
-	return map(lon, LON_WEST, LON_EAST, 0, MAP_WIDTH);
-}
-
-int16_t lat_to_y(int32_t lat) {
-	return map(lat, LAT_NORTH, LAT_SOUTH, 0, MAP_HEIGHT);
+int16_t cursorMapY() {
+	return (yegCurrY + cursorY) << zoom;
 }
 
 /* 
 	Retrieves a new restaurant block only if the current restaurant is not
-	in the current block.
+	in the current block.  If the block cannot be read the restaurant is
+	replaced by a placeholder named "(unreadable)", rated 0 and placed a
+	map width above and left of the map, so no dot is drawn for it and it
+	ranks behind every restaurant that was read.
 
 	Arguments:
 		restIndex (int): The index of the restaurant (0 to 1065)
 		restPtr (Restaurant*): Points to the restaurant address
 
 	Returns:
-		N/A
+		true if the restaurant was read, false for the placeholder
 */
-void getRestaurant(int restIndex, Restaurant* restPtr) {
+bool getRestaurant(int restIndex, Restaurant* restPtr) {
 	// determine block number from restIndex
 	uint32_t blockNum = REST_START_BLOCK + restIndex/8;
+	perf.rest_reads++;
 
 	// if the restaurant is in a new block, read the new block
 	if (blockNum != oldBlock) {
-		while (!card.readBlock(blockNum, (uint8_t*) restBlock)) {
-		    Serial.println("Read block failed, trying again.");
+		perf.rest_blocks++;
+		if (!sdread_block(&card, blockNum, (uint8_t*) restBlock)) {
+			// nothing of the block is left to reuse
+			oldBlock = 0;
+			restPtr->lat = 2*LAT_NORTH - LAT_SOUTH;
+			restPtr->lon = 2*LON_WEST - LON_EAST;
+			restPtr->rating = 0;
+			strcpy(restPtr->name, "(unreadable)");
+			return false;
 		}
 	}
 
@@ -181,27 +359,214 @@ void getRestaurant(int restIndex, Restaurant* restPtr) {
 
 	// reset oldBlock to be equal to the current block
 	oldBlock = blockNum;
+	return true;
 }
 
-/* 
-	Calculates Manhattan distance between two points
-	
+/*
+	Prints the number of restaurant blocks read from the SD card since a
+	snapshot of the counter was taken; only active when built with
+	-DREPORT_SD_BLOCKS
+
+	Arguments:
+		what (const __FlashStringHelper*): name of the query being reported
+		startBlocks (uint32_t): value of perf.rest_blocks before the query
+
+	Returns:
+		N/A
+*/
+void reportRestBlocks(const __FlashStringHelper* what, uint32_t startBlocks) {
+#ifdef REPORT_SD_BLOCKS
+	Serial.print(what);
+	Serial.print(F(": "));
+	Serial.print(perf.rest_blocks - startBlocks);
+	Serial.println(F(" restaurant blocks"));
+#endif
+}
+
+/*
+	Gets the map position and rating of a restaurant, from the flash table
+	when there is a valid one and from the SD card otherwise
+
+	Arguments:
+		restIndex (int): The index of the restaurant (0 to 1065)
+		posPtr (RestPos*): Points to the position to fill in
+
+	Returns:
+		true if the restaurant was read, false for the placeholder of
+		getRestaurant()
+*/
+bool getRestPos(int restIndex, RestPos* posPtr) {
+#ifdef REST_TABLE
+	if (restTableValid) {
+		memcpy_P(posPtr, &restTable[restIndex], sizeof(RestPos));
+		return true;
+	}
+#endif
+	ScratchScope scope;
+	Restaurant* rest = scope.alloc<Restaurant>();
+	bool read = getRestaurant(restIndex, rest);
+	posPtr->x = lon_to_x(rest->lon);
+	posPtr->y = lat_to_y(rest->lat);
+	posPtr->rating = rest->rating;
+	return read;
+}
+
+/*
+	Compares the flash restaurant table with the restaurants on the SD
+	card, so a table generated from other data than the card holds is
+	never used; getRestPos() reads the card instead.  Restaurants whose
+	block cannot be read are left out of the comparison, since the
+	placeholder getRestaurant() gives for them says nothing of the table.
+
+	Arguments:
+		N/A
+
+	Returns:
+		N/A
+*/
+void checkRestTable() {
+#ifdef REST_TABLE
+	restTableValid = false;
+	int mismatches = 0, unread = 0;
+	for (int i = 0; i < NUM_RESTAURANTS; i++) {
+		RestPos onCard, inFlash;
+		if (!getRestPos(i, &onCard)) {
+			unread++;
+			continue;
+		}
+		memcpy_P(&inFlash, &restTable[i], sizeof(RestPos));
+		if (onCard.x != inFlash.x || onCard.y != inFlash.y || onCard.rating != inFlash.rating) {
+			mismatches++;
+		}
+	}
+	if (unread > 0) {
+		Serial.print(unread);
+		Serial.println(F(" restaurants unreadable, not checked against the flash table"));
+	}
+	if (mismatches > 0) {
+		Serial.print(mismatches);
+		Serial.println(F(" restaurants differ from the flash table, using the SD card"));
+	} else {
+		Serial.println(F("Flash restaurant table OK"));
+		restTableValid = true;
+	}
+#endif
+}
+
+/*
+	Fetches one restaurant of a batch and hands it to the caller
+
+	Arguments:
+		restArray (RestDist*): the restaurants requested
+		slot (int): position of the restaurant in restArray
+		fields (uint8_t): REST_FIELD_ flags of the fields wanted
+		deliver (RestDeliver): receives the restaurant
+		context (void*): passed on to deliver
+
+	Returns:
+		N/A
+*/
+void fetchOne(const RestDist* restArray, int slot, uint8_t fields,
+		RestDeliver deliver, void* context) {
+	RestPos pos;
+	if (!(fields & REST_FIELD_NAME)) {
+		getRestPos(restArray[slot].index, &pos);
+		deliver(slot, pos, NULL, context);
+		return;
+	}
+	ScratchScope scope;
+	Restaurant* rest = scope.alloc<Restaurant>();
+	getRestaurant(restArray[slot].index, rest);
+	pos.x = lon_to_x(rest->lon);
+	pos.y = lat_to_y(rest->lat);
+	pos.rating = rest->rating;
+	deliver(slot, pos, rest->name, context);
+}
+
+/*
+	Fetches a batch of restaurants, reading each SD card block they lie in
+	only once and in ascending order.  There is no room to hold a whole
+	batch in memory, so each restaurant is handed to deliver as soon as it
+	is read, along with its position in the request: restaurants within a
+	block come in request order, blocks in card order.  Requests already
+	in card order are delivered in request order in a single pass, and
+	requests for positions alone read nothing from the card once the flash
+	table is checked.
+
+	Arguments:
+		restArray (RestDist*): the restaurants wanted, by index
+		count (int): number of restaurants in restArray
+		fields (uint8_t): REST_FIELD_ flags of the fields wanted
+		deliver (RestDeliver): receives each restaurant
+		context (void*): passed on to deliver
+
+	Returns:
+		N/A
+*/
+void fetchRestaurants(const RestDist* restArray, int count, uint8_t fields,
+		RestDeliver deliver, void* context) {
+	bool inOrder = count <= 1 || (restTableValid && !(fields & REST_FIELD_NAME));
+	for (int i = 1; i < count && !inOrder; i++) {
+		if (restArray[i].index/8 < restArray[i-1].index/8) {
+			break;
+		}
+		inOrder = i == count - 1;
+	}
+	if (inOrder) {
+		for (int i = 0; i < count; i++) {
+			fetchOne(restArray, i, fields, deliver, context);
+		}
+		return;
+	}
+
+	// visit the blocks holding requested restaurants from lowest to highest
+	int32_t lastBlock = -1;
+	while (true) {
+		int32_t block = INT32_MAX;
+		for (int i = 0; i < count; i++) {
+			int32_t b = restArray[i].index/8;
+			if (b > lastBlock && b < block) {
+				block = b;
+			}
+		}
+		if (block == INT32_MAX) {
+			break;
+		}
+		for (int i = 0; i < count; i++) {
+			if (restArray[i].index/8 == block) {
+				fetchOne(restArray, i, fields, deliver, context);
+			}
+		}
+		lastBlock = block;
+	}
+}
+
+/*
+	Ranks every restaurant rated at least minRating by a distance policy,
+	keeping the k nearest in a sorted list; ties stay in card order, as
+	isort() leaves them
+
 	Arguments:
-		x1 (int16_t): x coordinate of first point
-		x2 (int16_t): x coordinate of second point
-		y1 (int16_t): y coordinate of first point
-		y2 (int16_t): y coordinate of second point
+		top (RankedRest<Metric>*): room for k restaurants
+		x, y (int16_t): the point, on the full size map
+		k (int): number of restaurants to keep
 
 	Returns:
-		dist (int16_t): Manhattan distance between points
+		count (int): number of restaurants in top
 */
-int16_t manhattanDist(int16_t x1,int16_t x2,int16_t y1,int16_t y2) {
-	int16_t dist = abs(x1 - x2) + abs(y1 - y2);
-	return dist;
+template <class Metric>
+int rankNearest(RankedRest<Metric>* top, int16_t x, int16_t y, int k) {
+	return rest_rank_nearest(getRestPos, NUM_RESTAURANTS, x, y, minRating,
+		top, k);
 }
 
 /*
-	Gets an array of RestDist structures based on current location
+	Gets an array of RestDist structures based on current location, for
+	the restaurants rated at least minRating.  With a valid flash table
+	only the rating buckets that qualify are visited, so a higher
+	minRating makes the scan shorter.  Otherwise the restaurants are read
+	from the card and ranked by rest_rank_nearest() as they come, so the
+	list comes back sorted.
 
 	Arguments:
 		restDistArray (RestDist*): array of RestDist structs
@@ -209,23 +574,430 @@ int16_t manhattanDist(int16_t x1,int16_t x2,int16_t y1,int16_t y2) {
 		y (int16_t): current y location of cursor in terms of YEG map
 
 	Returns:
-		N/A
+		count (int): number of restaurants stored in restDistArray
 */
-void getRestDist(RestDist* restDistArray, int16_t x, int16_t y) {
+int getRestDist(RestDist* restDistArray, int16_t x, int16_t y) {
+#ifdef REPORT_SCAN_TIMES
+	// compares scans from the flash table and from the SD card
+	uint32_t scanStart = micros();
+#endif
 	// load array of RestDist structures
-	Restaurant rest;
+	int count = 0;
+#ifdef REST_TABLE
+	if (restTableValid) {
+		RestPos pos;
+		// the buckets of ratings minRating and up end the index
+		for (uint16_t k = pgm_read_word(&ratingStart[minRating]); k < NUM_RESTAURANTS; k++) {
+			uint16_t i = pgm_read_word(&restByRating[k]);
+			getRestPos(i, &pos);
+			restDistArray[count].index = i;
+			restDistArray[count].dist = RestMetric::dist(pos.x, pos.y, x, y);
+			count++;
+		}
+	} else
+#endif
+	count = rankNearest<RestMetric>(restDistArray, x, y, NUM_RESTAURANTS);
+#ifdef REPORT_SCAN_TIMES
+	Serial.print(F("scan "));
+	Serial.print(micros() - scanStart);
+	Serial.println(F(" us"));
+#endif
+	return count;
+}
+
+// called by the range queries with each restaurant found
+typedef void (*RestVisit)(uint16_t restIndex, const RestPos& pos, void* context);
+
+// work done by the most recent range query
+struct QueryStats {
+	uint16_t cells; // grid cells visited
+	uint16_t examined; // restaurants whose position was tested
+};
+QueryStats queryStats;
+
+// the nearest list holds this many restaurants; the search radius for
+// them starts small and doubles until enough are found
+#define NEAREST_COUNT 21
+#define NEAREST_START_RADIUS 64
+#define NEAREST_MAX_RADIUS 4096
+
+// scratch the sketch checks out at once: a restaurant read for its name
+// or position, or the lists of the "rank" command
+SCRATCH_ASSERT_FITS(2 * sizeof(Restaurant));
+SCRATCH_ASSERT_FITS(NEAREST_COUNT * (sizeof(uint16_t)
+	+ 2 * sizeof(RankedRest<EuclideanDistance>)));
+
+/*
+	Finds the restaurants rated at least minRating that lie in a rectangle
+	and, unless radius is negative, within Manhattan distance radius of a
+	point.  With a valid flash table only the grid cells overlapping the
+	rectangle are visited, so the cost follows the number of restaurants
+	near the answer rather than the number of restaurants; otherwise every
+	restaurant is tested.
+
+	Arguments:
+		x0, y0, x1, y1 (int16_t): corners of the rectangle on the full
+			size map, inclusive
+		cx, cy (int16_t): the point the radius is measured from
+		radius (int16_t): the largest distance allowed, or -1 for none
+		visit (RestVisit): called with each restaurant found, or NULL to
+			only count them
+		context (void*): passed on to visit
+
+	Returns:
+		count (int): number of restaurants found
+*/
+int queryRange(int16_t x0, int16_t y0, int16_t x1, int16_t y1,
+		int16_t cx, int16_t cy, int16_t radius, RestVisit visit, void* context) {
+	queryStats.cells = 0;
+	queryStats.examined = 0;
+	int count = 0;
+	RestPos pos;
+
+#ifdef REST_TABLE
+	if (restTableValid) {
+		// restaurants off the map are in the cells along its edges
+		int cellX0 = constrain(x0 >> REST_GRID_SHIFT, 0, REST_GRID_SIZE - 1);
+		int cellY0 = constrain(y0 >> REST_GRID_SHIFT, 0, REST_GRID_SIZE - 1);
+		int cellX1 = constrain(x1 >> REST_GRID_SHIFT, 0, REST_GRID_SIZE - 1);
+		int cellY1 = constrain(y1 >> REST_GRID_SHIFT, 0, REST_GRID_SIZE - 1);
+		for (int cellY = cellY0; cellY <= cellY1; cellY++) {
+			for (int cellX = cellX0; cellX <= cellX1; cellX++) {
+				int cell = cellY * REST_GRID_SIZE + cellX;
+				queryStats.cells++;
+				uint16_t end = pgm_read_word(&cellStart[cell + 1]);
+				for (uint16_t k = pgm_read_word(&cellStart[cell]); k < end; k++) {
+					uint16_t i = pgm_read_word(&restByCell[k]);
+					getRestPos(i, &pos);
+					queryStats.examined++;
+					if (pos.rating >= minRating
+						&& pos.x >= x0 && pos.x <= x1 && pos.y >= y0 && pos.y <= y1
+						&& (radius < 0 || ManhattanDistance::dist(pos.x, pos.y, cx, cy) <= radius)) {
+						count++;
+						if (visit != NULL) {
+							visit(i, pos, context);
+						}
+					}
+				}
+			}
+		}
+		return count;
+	}
+#endif
+
 	for (int i = 0; i < NUM_RESTAURANTS; i++) {
-		// load a restaurant from SD card
-		getRestaurant(i, &rest);
-		restDistArray[i].index = i;
-		// store index and distance as RestDist struct in rest_dist array
-		int32_t lat = rest.lat;
-		int32_t lon = rest.lon;
-		int16_t xPoint = lon_to_x(lon);
-		int16_t yPoint = lat_to_y(lat);
-		// calculate manhattan distance and store in rest_dist
-		restDistArray[i].dist = manhattanDist(xPoint, x, yPoint, y);
+		getRestPos(i, &pos);
+		queryStats.examined++;
+		if (pos.rating >= minRating
+			&& pos.x >= x0 && pos.x <= x1 && pos.y >= y0 && pos.y <= y1
+			&& (radius < 0 || ManhattanDistance::dist(pos.x, pos.y, cx, cy) <= radius)) {
+			count++;
+			if (visit != NULL) {
+				visit(i, pos, context);
+			}
+		}
+	}
+	return count;
+}
+
+/*
+	Finds the restaurants rated at least minRating in a rectangle
+
+	Arguments:
+		x0, y0, x1, y1 (int16_t): corners of the rectangle on the full
+			size map, inclusive
+		visit (RestVisit): called with each restaurant found, or NULL to
+			only count them
+		context (void*): passed on to visit
+
+	Returns:
+		count (int): number of restaurants found
+*/
+int queryRect(int16_t x0, int16_t y0, int16_t x1, int16_t y1,
+		RestVisit visit, void* context) {
+	return queryRange(x0, y0, x1, y1, 0, 0, -1, visit, context);
+}
+
+/*
+	Finds the restaurants rated at least minRating within a Manhattan
+	distance of a point
+
+	Arguments:
+		x, y (int16_t): the point, on the full size map
+		radius (int16_t): the largest distance allowed
+		visit (RestVisit): called with each restaurant found, or NULL to
+			only count them
+		context (void*): passed on to visit
+
+	Returns:
+		count (int): number of restaurants found
+*/
+int queryRadius(int16_t x, int16_t y, int16_t radius, RestVisit visit, void* context) {
+	return queryRange(x - radius, y - radius, x + radius, y + radius,
+		x, y, radius, visit, context);
+}
+
+// where nearestRestaurants() collects the restaurants found
+struct NearestList {
+	RestDist* array;
+	int count;
+	int16_t x, y;
+};
+
+/*
+	Adds a restaurant found by a range query to a NearestList; a RestVisit
+
+	Arguments:
+		restIndex (uint16_t): the restaurant
+		pos (RestPos&): its position
+		context (void*): the NearestList
+
+	Returns:
+		N/A
+*/
+void addNearest(uint16_t restIndex, const RestPos& pos, void* context) {
+	NearestList* list = (NearestList*) context;
+	list->array[list->count].index = restIndex;
+	list->array[list->count].dist = RestMetric::dist(pos.x, pos.y, list->x, list->y);
+	list->count++;
+}
+
+/*
+	Gets the restaurants closest to a point, at least the NEAREST_COUNT
+	nearest when there are that many, unsorted.  Radius queries grow until
+	they find enough, so only the restaurants around the point are
+	examined, and only those have to be sorted.  Without the flash table
+	every restaurant is listed, as getRestDist() does.
+
+	The radius is a Manhattan one whatever RestMetric is, so the list is
+	taken from the square around it: a restaurant nearer than the
+	NEAREST_COUNT found by a straight line lies in that square too.  The
+	square has a margin for EquirectDistance, whose pixels are not
+	exactly as tall as they are wide.
+
+	Arguments:
+		restDistArray (RestDist*): array of RestDist structs
+		x, y (int16_t): the point, on the full size map
+
+	Returns:
+		count (int): number of restaurants stored in restDistArray
+*/
+int nearestRestaurants(RestDist* restDistArray, int16_t x, int16_t y) {
+	if (!restTableValid) {
+		return getRestDist(restDistArray, x, y);
+	}
+	int16_t radius = NEAREST_START_RADIUS;
+	while (queryRadius(x, y, radius, NULL, NULL) < NEAREST_COUNT) {
+		if (radius == NEAREST_MAX_RADIUS) {
+			// fewer than NEAREST_COUNT qualify anywhere near the map
+			return getRestDist(restDistArray, x, y);
+		}
+		radius *= 2;
+	}
+	NearestList list = {restDistArray, 0, x, y};
+	int16_t reach = radius + radius/16;
+	queryRect(x - reach, y - reach, x + reach, y + reach, addNearest, &list);
+	return list.count;
+}
+
+/*
+	Answers the console commands that benchmark the range queries, run
+	around the cursor:
+		radius <r>  restaurants within distance r
+		rect <w>    restaurants in a square w pixels across
+	Each prints what was found and the work it took.
+
+	Arguments:
+		line (const char*): the command
+
+	Returns:
+		true if the command was one of these
+*/
+bool queryCommand(const char* line) {
+	bool isRadius = strncmp(line, "radius ", 7) == 0;
+	bool isRect = strncmp(line, "rect ", 5) == 0;
+	if (!isRadius && !isRect) {
+		return false;
+	}
+	int16_t size = atoi(line + (isRadius ? 7 : 5));
+	int16_t x = cursorMapX(), y = cursorMapY();
+
+	uint32_t start = micros();
+	int count = isRadius ? queryRadius(x, y, size, NULL, NULL)
+		: queryRect(x - size/2, y - size/2, x + size/2, y + size/2, NULL, NULL);
+	uint32_t time = micros() - start;
+
+	Serial.print(line);
+	Serial.print(F(": "));
+	Serial.print(count);
+	Serial.print(F(" found, "));
+	Serial.print(queryStats.examined);
+	Serial.print(F(" examined, "));
+	Serial.print(queryStats.cells);
+	Serial.print(F(" cells, "));
+	Serial.print(time);
+	Serial.println(F(" us"));
+	return true;
+}
+
+/*
+	Times rankNearest() with a distance policy and prints how its list
+	compares with a reference one
+
+	Arguments:
+		reference (uint16_t*): restaurants of the reference list, nearest
+			first
+		refCount (int): number of restaurants in reference
+		x, y (int16_t): the point, on the full size map
+
+	Returns:
+		N/A
+*/
+template <class Metric>
+void reportRanking(const uint16_t* reference, int refCount, int16_t x, int16_t y) {
+	ScratchScope scope;
+	RankedRest<Metric>* top = scope.alloc<RankedRest<Metric> >(NEAREST_COUNT);
+	uint32_t start = micros();
+	int count = rankNearest<Metric>(top, x, y, NEAREST_COUNT);
+	uint32_t time = micros() - start;
+
+	int shared = 0, inPlace = 0;
+	for (int i = 0; i < count; i++) {
+		for (int j = 0; j < refCount; j++) {
+			if (top[i].index == reference[j]) {
+				shared++;
+				inPlace += i == j;
+				break;
+			}
+		}
+	}
+	Serial.print(Metric::name());
+	Serial.print(F(": "));
+	Serial.print(time);
+	Serial.print(F(" us, "));
+	Serial.print(shared);
+	Serial.print(F("/"));
+	Serial.print(refCount);
+	Serial.print(F(" shared, "));
+	Serial.print(inPlace);
+	Serial.println(F(" in place"));
+}
+
+/*
+	Answers the console command "rank", which ranks the restaurants
+	around the cursor with each distance policy and compares the nearest
+	lists with the exact Euclidean one
+
+	Arguments:
+		line (const char*): the command
+
+	Returns:
+		true if the command was "rank"
+*/
+bool rankCommand(const char* line) {
+	if (strcmp(line, "rank") != 0) {
+		return false;
+	}
+	int16_t x = cursorMapX(), y = cursorMapY();
+	ScratchScope scope;
+	uint16_t* reference = scope.alloc<uint16_t>(NEAREST_COUNT);
+	int refCount;
+	{
+		ScratchScope topScope;
+		RankedRest<EuclideanDistance>* top =
+			topScope.alloc<RankedRest<EuclideanDistance> >(NEAREST_COUNT);
+		refCount = rankNearest<EuclideanDistance>(top, x, y, NEAREST_COUNT);
+		for (int i = 0; i < refCount; i++) {
+			reference[i] = top[i].index;
+		}
+	}
+	reportRanking<ManhattanDistance>(reference, refCount, x, y);
+	reportRanking<EuclideanDistance>(reference, refCount, x, y);
+	reportRanking<EquirectDistance>(reference, refCount, x, y);
+	return true;
+}
+
+/*
+	Counts the page turns of the joystick along one axis needed to bring
+	a point of the map on screen; each turn moves the map by a screen,
+	stopping at the edges of the map as drawNextPatch() does
+
+	Arguments:
+		start (int): where the screen starts, on the level shown
+		dest (int): the point
+		step (int): the size of the screen
+		end (int): the furthest the screen can start
+
+	Returns:
+		the number of page turns
+*/
+int pageTurns(int start, int dest, int step, int end) {
+	int turns = 0;
+	while (dest < start && start > 0) {
+		start = max(start - step, 0);
+		turns++;
+	}
+	while (dest >= start + step && start < end) {
+		start = min(start + step, end);
+		turns++;
+	}
+	return turns;
+}
+
+/*
+	Answers the console command "jumps <n>", which picks n points of the
+	map at random and prints the pages that would be drawn to bring each
+	on screen from the current view: by turning pages with the joystick,
+	and by tapping the minimap, which draws one page unless the point is
+	already shown.  The same points are picked every time.
+
+	Arguments:
+		line (const char*): the command
+
+	Returns:
+		true if the command was "jumps"
+*/
+bool jumpCommand(const char* line) {
+	if (strncmp(line, "jumps ", 6) != 0) {
+		return false;
+	}
+	int count = atoi(line + 6);
+	int width = min(MAP_DISP_WIDTH, LEVEL_WIDTH);
+	int height = min(MAP_DISP_HEIGHT, LEVEL_HEIGHT);
+	uint32_t seed = 1;
+	uint32_t joystick = 0, minimap = 0;
+	for (int i = 0; i < count; i++) {
+		seed = seed * 1103515245UL + 12345;
+		int x = (seed >> 8) % LEVEL_WIDTH;
+		seed = seed * 1103515245UL + 12345;
+		int y = (seed >> 8) % LEVEL_HEIGHT;
+		uint16_t turns = pageTurns(yegCurrX, x, width, YEG_X_MAX)
+			+ pageTurns(yegCurrY, y, height, YEG_Y_MAX);
+		joystick += turns;
+		minimap += turns > 0 ? 1 : 0;
 	}
+
+	Serial.print(line);
+	Serial.print(F(": joystick "));
+	Serial.print(joystick);
+	Serial.print(F(" pages, minimap "));
+	Serial.print(minimap);
+	Serial.println(F(" pages"));
+	return true;
+}
+
+/*
+	Answers the console commands of the sketch
+
+	Arguments:
+		line (const char*): the command
+
+	Returns:
+		true if the command was one of queryCommand(), rankCommand() or
+		jumpCommand()
+*/
+bool sketchCommand(const char* line) {
+	return queryCommand(line) || rankCommand(line) || jumpCommand(line);
 }
 
 /*
@@ -245,7 +1017,8 @@ void swap(RestDist &x,RestDist &y) {
 }
 
 /*
-	Insertion sort function, taken from assignment description, sorts by distance from cursor
+	Insertion sort function, taken from assignment description, sorts by distance from cursor;
+	restaurants equally far away stay in card order, however they were found
 
 	Arguments:
 		distArray (RestDist*): declares a pointer to array storing index and distances of restaurants
@@ -256,37 +1029,60 @@ void swap(RestDist &x,RestDist &y) {
 */
 void isort(RestDist* distArray, int length) {
 	for (int i = 1; i < length; ++i) {
-		for (int j = i; j > 0 && distArray[j].dist < distArray[j-1].dist; --j) {
+		for (int j = i; j > 0 && (distArray[j].dist < distArray[j-1].dist
+				|| (distArray[j].dist == distArray[j-1].dist
+					&& distArray[j].index < distArray[j-1].index)); --j) {
 			swap(distArray[j], distArray[j-1]);
 		}
 	}
 }
 
+/*
+	Prints one name of the list of closest restaurants, in the row given by
+	its place in the list; a RestDeliver for fetchRestaurants()
+
+	Arguments:
+		slot (int): place of the restaurant in the list
+		pos (RestPos&): unused
+		name (const char*): name of the restaurant
+		context (void*): unused
+
+	Returns:
+		N/A
+*/
+void displayName(int slot, const RestPos& pos, const char* name, void* context) {
+	tft.setCursor(0, 16*slot);
+	if (slot != 0) { // not highlighted
+		tft.setTextColor(0xFFFF, 0x0000);
+	} else { // highlighted
+		tft.setTextColor(0x0000, 0xFFFF);
+	}
+	perf.chars += tft.print(name);
+}
+
 /* 
 	Displays the list of closest restaurants to the cursor coordinates
 	
 	Arguments: 
 		restArray (RestDist*): Array of restDist structs
+		count (int): number of restaurants in restArray
 
 	Returns:
 		N/A
 */
-void displayNames(RestDist* restArray) {
+void displayNames(RestDist* restArray, int count) {
+	uint32_t startBlocks = perf.rest_blocks;
 	tft.fillScreen(0);
-	tft.setCursor(0,0);
-
-	for (int16_t i = 0; i < 21; i++) {
-		Restaurant r;
-		getRestaurant(restArray[i].index, &r);
-		if (i != 0) { // not highlighted
-			tft.setTextColor(0xFFFF, 0x0000);
-		} else { // highlighted
-			tft.setTextColor(0x0000, 0xFFFF);
-		}
-		tft.print(r.name);
-		tft.print("\n");
+	if (count == 0) {
+		tft.setCursor(0, 0);
+		tft.setTextColor(0xFFFF, 0x0000);
+		tft.print(F("No restaurants rated "));
+		tft.print(minRating);
+		tft.print(F(" or more"));
+		return;
 	}
-	tft.print("\n");
+	fetchRestaurants(restArray, min(count, 21), REST_FIELD_NAME, displayName, NULL);
+	reportRestBlocks(F("displayNames"), startBlocks);
 }
 
 /*
@@ -300,21 +1096,21 @@ void displayNames(RestDist* restArray) {
 		N/A
 */
 void moveHighlight(RestDist* restArray, int x) {
+	ScratchScope scope;
+	Restaurant* rest = scope.alloc<Restaurant>();
 	// get info for old restaurant
 	tft.setCursor(0,16*x+1);
-	Restaurant oldRest;
-	getRestaurant(restArray[x].index, &oldRest);
+	getRestaurant(restArray[x].index, rest);
 	// unhighlight old restaurant
 	tft.setTextColor(0xFFFF, 0x0000);
-	tft.print(oldRest.name);
+	perf.chars += tft.print(rest->name);
 
 	// set cursor at new position
 	tft.setCursor(0, 16*selectedRest+1);
-	Restaurant newRest;
-	getRestaurant(restArray[selectedRest].index, &newRest);
+	getRestaurant(restArray[selectedRest].index, rest);
 	// highlight new restaurant
 	tft.setTextColor(0x0000, 0xFFFF);
-	tft.print(newRest.name);
+	perf.chars += tft.print(rest->name);
 }
 
 /*
@@ -329,7 +1125,9 @@ void moveHighlight(RestDist* restArray, int x) {
 void joystickMode1() {
 	int prevRest = selectedRest;
 	int yVal = analogRead(JOYSTICK_VERT);
-	selectedRest = constrain(selectedRest, 0, 20);
+	// a filtered list can be shorter than 21
+	int lastRest = min(20, restCount - 1);
+	selectedRest = constrain(selectedRest, 0, lastRest);
 
 	// joystick up
 	if (yVal < JOY_CENTER - JOY_DEADZONE) {
@@ -343,7 +1141,7 @@ void joystickMode1() {
 	if (yVal > JOY_CENTER + JOY_DEADZONE) {
 		selectedRest++;
 		Serial.println("Joystick Down");
-		if (selectedRest != prevRest && selectedRest < 20) {
+		if (selectedRest != prevRest && selectedRest < lastRest) {
 			moveHighlight(rest_dist, prevRest);
 		}
 	}
@@ -352,8 +1150,14 @@ void joystickMode1() {
 // forward declaration of mode0
 void mode0();
 
+// smallest change in a joystick reading worth recording
+#define TRACE_JOY_STEP 16
+
 /*
-	Implementation of mode1 as specified in assignment description
+	Prints the joystick and touch screen state over Serial as a trace
+	sample whenever it has changed, so a session captured from the serial
+	monitor can be replayed by the simulator in sim/. Does nothing unless
+	built with -DTRACE_RECORD.
 
 	Arguments:
 		N/A
@@ -361,320 +1165,1995 @@ void mode0();
 	Returns:
 		N/A
 */
-void mode1() {
-	// load restaurant data into array of RestDist structs
-	getRestDist(rest_dist, yegCurrX + cursorX, yegCurrY + cursorY);
-	Serial.println("Created RestDist");
-	// sort array of RestDist structs by distance
-	isort(rest_dist, NUM_RESTAURANTS);
-	Serial.println("Sorted");
-	// display the list on the screen
-	displayNames(rest_dist);
-	Serial.println("Displayed");
-	// if joystick is moved, scroll through list
-	// if joystick is pressed, go back to map display
-	while (digitalRead(JOYSTICK_SEL) == HIGH) {
-		joystickMode1();
+void recordTrace() {
+#ifdef TRACE_RECORD
+	static int lastX = -1, lastY = -1, lastSel = -1, lastZ = -1;
+	int xVal = analogRead(JOYSTICK_HORIZ);
+	int yVal = analogRead(JOYSTICK_VERT);
+	int sel = digitalRead(JOYSTICK_SEL);
+	TSPoint touch = ts.getPoint();
+	pinMode(YP, OUTPUT);
+	pinMode(XM, OUTPUT);
+	if (touch.z < MINPRESSURE || touch.z > MAXPRESSURE) {
+		touch.x = touch.y = touch.z = 0;
 	}
-	mode0();
-}
-
-/*
-	Draws a cursor on the TFT display
-
-	Arguments: 
-		colour (uint16_t): the desired TFT color
 
-	Returns: 
-		N/A
-*/
-void redrawCursor(uint16_t colour) {
-  tft.fillRect(cursorX - CURSOR_SIZE/2, cursorY - CURSOR_SIZE/2,
-               CURSOR_SIZE, CURSOR_SIZE, colour);
+	if (abs(xVal - lastX) < TRACE_JOY_STEP && abs(yVal - lastY) < TRACE_JOY_STEP
+		&& sel == lastSel && (touch.z > 0) == (lastZ > 0)) {
+		return;
+	}
+	lastX = xVal;
+	lastY = yVal;
+	lastSel = sel;
+	lastZ = touch.z;
+
+	Serial.print(F("T "));
+	Serial.print(millis());
+	Serial.print(' ');
+	Serial.print(xVal);
+	Serial.print(' ');
+	Serial.print(yVal);
+	Serial.print(' ');
+	Serial.print(sel);
+	Serial.print(' ');
+	Serial.print(touch.x);
+	Serial.print(' ');
+	Serial.print(touch.y);
+	Serial.print(' ');
+	Serial.println(touch.z);
+#endif
 }
 
+// once the cursor has rested PRECOMPUTE_DELAY ms the nearest list for it
+// is worked out in the background, PRECOMPUTE_CHUNK restaurants for each
+// pass of the mode0 loop so the joystick is never held up for long
+#define PRECOMPUTE_DELAY 500
+#define PRECOMPUTE_CHUNK 32
+
+// state of the nearest list being worked out in rest_dist ahead of mode1
+struct Precompute {
+	int16_t x, y; // map position the list is for
+	uint8_t minRating; // the rating filter it is for
+	uint32_t restingSince; // when the cursor came to rest there
+	int next; // next restaurant to rank, NUM_RESTAURANTS once done
+	int count; // restaurants ranked into rest_dist so far
+};
+Precompute precompute = {-1, -1, 0, 0, 0, 0};
+
 /*
-	Redraws portion of map that cursor has just left to prevent black trail
+	Does the next piece of work towards the nearest list for the cursor,
+	so that mode1 can show it without ranking anything.  Any move of the
+	cursor or the map, or a new rating filter, throws away what was done
+	and starts the wait again.  Waits for the map to finish drawing.
+
+	With the flash table the list takes only a radius query and a short
+	sort, so it is made at once.  Otherwise restaurants are read from the
+	card a chunk at a time and each is inserted in order into rest_dist by
+	rest_rank_insert(), as rest_rank_nearest() does; taken in card order,
+	restaurants equally far away end up in card order just as isort()
+	leaves them.
 
 	Arguments:
 		N/A
 
-	Returns: 
-		N/a
+	Returns:
+		N/A
 */
-void redrawMap() {
-    int adjustX = prevX - CURSOR_SIZE/2;
-    int adjustY = prevY - CURSOR_SIZE/2;
-    int mapPosX = yegCurrX + adjustX;
-    int mapPosY = yegCurrY + adjustY;
-    lcd_image_draw(&yegImage, &tft, mapPosX, mapPosY,
-                   adjustX, adjustY,
-                   CURSOR_SIZE, CURSOR_SIZE);
-}
-
-/* 
+void precomputeNearest() {
+	int16_t x = cursorMapX();
+	int16_t y = cursorMapY();
+	if (x != precompute.x || y != precompute.y || minRating != precompute.minRating) {
+		precompute.x = x;
+		precompute.y = y;
+		precompute.minRating = minRating;
+		precompute.restingSince = millis();
+		precompute.next = 0;
+		precompute.count = 0;
+		return;
+	}
+	if (precompute.next == NUM_RESTAURANTS || refinePending
+			|| millis() - precompute.restingSince < PRECOMPUTE_DELAY) {
+		return;
+	}
+
+	if (restTableValid) {
+		precompute.count = nearestRestaurants(rest_dist, x, y);
+		isort(rest_dist, precompute.count);
+		precompute.next = NUM_RESTAURANTS;
+		return;
+	}
+	int end = min(precompute.next + PRECOMPUTE_CHUNK, NUM_RESTAURANTS);
+	RestPos pos;
+	for (int i = precompute.next; i < end; i++) {
+		getRestPos(i, &pos);
+		if (pos.rating < minRating) {
+			continue;
+		}
+		rest_rank_insert<RestMetric>(rest_dist, precompute.count,
+			NUM_RESTAURANTS, i, RestMetric::dist(pos.x, pos.y, x, y));
+	}
+	precompute.next = end;
+}
+
+/*
+	Prints whether the nearest list was ready when the joystick was
+	pressed, how long it took to show and the hit rate so far; only active
+	when built with -DREPORT_LIST_TIMES
+
+	Arguments:
+		hit (bool): true if the precomputed list was used
+		startTime (uint32_t): millis() when mode1 was entered
+
+	Returns:
+		N/A
+*/
+void reportListTime(bool hit, uint32_t startTime) {
+#ifdef REPORT_LIST_TIMES
+	Serial.print(hit ? F("list precomputed, shown in ") : F("list ranked, shown in "));
+	Serial.print(millis() - startTime);
+	Serial.print(F(" ms, "));
+	Serial.print(perf.list_hits);
+	Serial.print(F(" of "));
+	Serial.print(perf.list_hits + perf.list_misses);
+	Serial.println(F(" precomputed"));
+#endif
+}
+
+// forward declaration
+void putTouchedFirst();
+
+/*
+	Implementation of mode1 as specified in assignment description
+
+	Arguments:
+		N/A
+
+	Returns:
+		N/A
+*/
+void mode1() {
+	uint32_t startTime = millis();
+	int16_t x = cursorMapX();
+	int16_t y = cursorMapY();
+	bool hit = precompute.next == NUM_RESTAURANTS && precompute.x == x
+		&& precompute.y == y && precompute.minRating == minRating;
+	if (hit) {
+		// the list was made while the cursor rested here
+		perf.list_hits++;
+		restCount = precompute.count;
+		Serial.println(F("Precomputed RestDist"));
+	} else {
+		perf.list_misses++;
+		// load restaurant data into array of RestDist structs
+		restCount = nearestRestaurants(rest_dist, x, y);
+		Serial.println(F("Created RestDist"));
+		// sort array of RestDist structs by distance
+		isort(rest_dist, restCount);
+		Serial.println(F("Sorted"));
+		// rest_dist now holds the finished list for this spot
+		precompute.x = x;
+		precompute.y = y;
+		precompute.minRating = minRating;
+		precompute.next = NUM_RESTAURANTS;
+		precompute.count = restCount;
+	}
+	putTouchedFirst();
+	hud_rank(millis() - startTime);
+	// display the list on the screen
+	displayNames(rest_dist, restCount);
+	Serial.println("Displayed");
+	reportListTime(hit, startTime);
+	// if joystick is moved, scroll through list
+	// if joystick is pressed, go back to map display
+	while (digitalRead(JOYSTICK_SEL) == HIGH) {
+		recordTrace();
+		perf_poll();
+		joystickMode1();
+		hud_frame();
+	}
+	recordTrace();
+	mode0();
+}
+
+/*
+	Draws a cursor on the TFT display
+
+	Arguments: 
+		colour (uint16_t): the desired TFT color
+
+	Returns: 
+		N/A
+*/
+void redrawCursor(uint16_t colour) {
+  perf.rects++;
+  tft.fillRect(cursorX - CURSOR_SIZE/2, cursorY - CURSOR_SIZE/2,
+               CURSOR_SIZE, CURSOR_SIZE, colour);
+}
+
+/*
+	Prints the number of SD blocks read by lcd_image_draw() since a
+	snapshot of the counter was taken; only active when built with
+	-DREPORT_SD_BLOCKS since printing slows down every cursor move
+
+	Arguments:
+		what (const __FlashStringHelper*): name of the drawing routine being reported
+		startBlocks (uint32_t): value of lcd_image_stats.blocks before drawing
+
+	Returns:
+		N/A
+*/
+void reportBlocks(const __FlashStringHelper* what, uint32_t startBlocks) {
+#ifdef REPORT_SD_BLOCKS
+	Serial.print(what);
+	Serial.print(F(": "));
+	Serial.print(lcd_image_stats.blocks - startBlocks);
+	Serial.println(F(" blocks"));
+#endif
+}
+
+/*
+	Prints how long the last page turn took to first cover the map area
+	and to finish at full resolution; only active when built with
+	-DREPORT_FRAME_TIMES
+
+	Arguments:
+		N/A
+
+	Returns:
+		N/A
+*/
+void reportFrameTimes() {
+#ifdef REPORT_FRAME_TIMES
+	Serial.print(F("first frame "));
+	Serial.print(firstFrameTime);
+	Serial.print(F(" ms, final frame "));
+	Serial.print(finalFrameTime);
+	Serial.println(F(" ms"));
+#endif
+}
+
+/*
+	Draws the map at the current zoom level and position over the whole map
+	part of the display, blanking whatever the map does not cover when the
+	zoomed out levels are smaller than the display
+
+	Arguments:
+		N/A
+
+	Returns:
+		N/A
+*/
+void drawViewport() {
+	int width = min(MAP_DISP_WIDTH, LEVEL_WIDTH);
+	int height = min(MAP_DISP_HEIGHT, LEVEL_HEIGHT);
+	int coarse = min(zoom + PROGRESSIVE_STEPS, NUM_ZOOM_LEVELS - 1);
+	frameStart = millis();
+
+	if (progressiveDraw && coarse > zoom) {
+		// show the coarse level now, the rest is done by refineViewport()
+		int shift = coarse - zoom;
+		lcd_image_draw_scaled(&yegLevels[coarse], &tft,
+					   yegCurrX >> shift, yegCurrY >> shift,
+					   0, 0,
+					   width >> shift, height >> shift, shift);
+		lcd_image_progress_start(&refine, &yegLevels[zoom],
+					   yegCurrX, yegCurrY,
+					   0, 0,
+					   width, height);
+		refinePending = true;
+	} else {
+		lcd_image_draw(&yegLevels[zoom], &tft,
+					   yegCurrX, yegCurrY,
+					   0, 0,
+					   width, height);
+		refinePending = false;
+	}
+
+	if (width < MAP_DISP_WIDTH) {
+		tft.fillRect(width, 0, MAP_DISP_WIDTH - width, MAP_DISP_HEIGHT, TFT_BLACK);
+		perf.rects++;
+	}
+	if (height < MAP_DISP_HEIGHT) {
+		tft.fillRect(0, height, width, MAP_DISP_HEIGHT - height, TFT_BLACK);
+		perf.rects++;
+	}
+
+	// the whole map is new, so no dots are left over it
+	isDrawn = false;
+	perf.pages++;
+
+	firstFrameTime = millis() - frameStart;
+	if (!refinePending) {
+		finalFrameTime = firstFrameTime;
+		reportFrameTimes();
+	}
+}
+
+/*
+	Checks whether the joystick has been moved or pressed, used to pause
+	the progressive drawing of the map
+
+	Arguments:
+		N/A
+
+	Returns:
+		true if there is joystick input waiting to be handled
+*/
+bool joystickActive() {
+	int xVal = analogRead(JOYSTICK_HORIZ);
+	int yVal = analogRead(JOYSTICK_VERT);
+	return abs(xVal - JOY_CENTER) > JOY_DEADZONE
+		|| abs(yVal - JOY_CENTER) > JOY_DEADZONE
+		|| digitalRead(JOYSTICK_SEL) == LOW;
+}
+
+/*
+	Continues drawing the current map page at full resolution after
+	drawViewport() has shown the coarse version, then puts the cursor
+	back on top
+
+	Arguments:
+		interruptible (bool): if true, stop as soon as the joystick is used
+			and leave the rest for a later call
+
+	Returns:
+		N/A
+*/
+void refineViewport(bool interruptible) {
+	if (!refinePending) {
+		return;
+	}
+	if (lcd_image_progress_step(&refine, &tft, interruptible ? joystickActive : NULL)) {
+		refinePending = false;
+		finalFrameTime = millis() - frameStart;
+		reportFrameTimes();
+	}
+	redrawCursor(TFT_RED);
+}
+
+/* 
 	Redraws map patch to fill new display screen
 
 	Arguments:
-		xDirection (int): Should be either 1, meaning right, -1, meaning left, or 0 meaning no change
-		yDirection (int): Should be either 1, meaning down, or -1, meaning up, or 0 meaning no change
-	
+		xDirection (int): Should be either 1, meaning right, -1, meaning left, or 0 meaning no change
+		yDirection (int): Should be either 1, meaning down, or -1, meaning up, or 0 meaning no change
+	
+	Returns:
+		N/A
+*/
+void drawNextPatch(int xDirection, int yDirection) {
+
+	// adjusts the x position of the map patch drawn
+	yegCurrX = yegCurrX + MAP_DISP_WIDTH * (xDirection);
+	yegCurrX = constrain(yegCurrX, 0, YEG_X_MAX);
+
+	// adjusts the y position of the map patch drawn
+	yegCurrY = yegCurrY + MAP_DISP_HEIGHT * (yDirection);
+	yegCurrY = constrain(yegCurrY, 0, YEG_Y_MAX);
+
+	// set the cursor to display in the middle of the screen
+	cursorX = MAP_DISP_WIDTH/2;
+	cursorY = MAP_DISP_HEIGHT/2;
+
+	// draws next patch
+	uint32_t startBlocks = lcd_image_stats.blocks;
+	drawViewport();
+	reportBlocks(F("drawNextPatch"), startBlocks);
+
+}
+
+// forward declaration
+void centerOnRestaurant(int restIndex);
+
+/*
+	Draws a new patch of the map based on the cursor position
+
+	Arguments:
+		N/A
+
+	Returns:
+		N/A
+*/
+void selectedRestPatch() {
+	// with nothing listed there is nothing selected; stay put
+	if (restCount == 0) {
+		drawViewport();
+		redrawCursor(TFT_RED);
+		return;
+	}
+
+	centerOnRestaurant(rest_dist[selectedRest].index);
+}
+
+/*
+	Draws the patch of the map centered on a restaurant, with the cursor
+	over it
+
+	Arguments:
+		restIndex (int): The index of the restaurant (0 to 1065)
+
+	Returns:
+		N/A
+*/
+void centerOnRestaurant(int restIndex) {
+	// get coordinates of the restaurant
+	RestPos currentRest;
+	getRestPos(restIndex, &currentRest);
+
+	// values of coordinates on the map at the current zoom level
+	int currRestX = currentRest.x >> zoom;
+	int currRestY = currentRest.y >> zoom;
+
+	// center the map on the restaurant as far as the map edges allow,
+	// then put the cursor over it, or as close as it can get when the
+	// restaurant lies off the map
+	yegCurrX = constrain(currRestX - MAP_DISP_WIDTH/2, 0, YEG_X_MAX);
+	yegCurrY = constrain(currRestY - MAP_DISP_HEIGHT/2, 0, YEG_Y_MAX);
+	cursorX = constrain(currRestX - yegCurrX, 0, CURSOR_X_MAX);
+	cursorY = constrain(currRestY - yegCurrY, 0, CURSOR_Y_MAX);
+
+	// draw the patch of the map with the restaurant located in the middle
+	drawViewport();
+
+	// draw cursor
+	redrawCursor(TFT_RED);
+}
+
+// forward declaration
+void restaurantDraw();
+void reDrawDots();
+bool touchDot(int16_t screenX, int16_t screenY);
+void resetMinimap();
+void jumpToMinimap(int16_t screenX, int16_t screenY);
+
+/*
+	Draws the zoom in and zoom out buttons at the bottom of the sidebar
+
+	Arguments:
+		N/A
+
+	Returns:
+		N/A
+*/
+void drawZoomButtons() {
+	tft.setTextColor(TFT_WHITE, TFT_BLACK);
+	tft.drawRect(SIDEBAR_X, ZOOM_IN_Y, SIDEBAR_WIDTH, ZOOM_BTN_HEIGHT, TFT_WHITE);
+	tft.setCursor(SIDEBAR_X + SIDEBAR_WIDTH/2 - 5, ZOOM_IN_Y + ZOOM_BTN_HEIGHT/2 - 7);
+	tft.print('+');
+	tft.drawRect(SIDEBAR_X, ZOOM_OUT_Y, SIDEBAR_WIDTH, ZOOM_BTN_HEIGHT, TFT_WHITE);
+	tft.setCursor(SIDEBAR_X + SIDEBAR_WIDTH/2 - 5, ZOOM_OUT_Y + ZOOM_BTN_HEIGHT/2 - 7);
+	tft.print('-');
+}
+
+/*
+	Draws the rating filter button, showing the lowest rating shown
+
+	Arguments:
+		N/A
+
+	Returns:
+		N/A
+*/
+void drawRatingButton() {
+	tft.fillRect(SIDEBAR_X, RATING_BTN_Y, SIDEBAR_WIDTH, ZOOM_BTN_HEIGHT, TFT_BLACK);
+	perf.rects++;
+	tft.drawRect(SIDEBAR_X, RATING_BTN_Y, SIDEBAR_WIDTH, ZOOM_BTN_HEIGHT, TFT_WHITE);
+	tft.setTextColor(TFT_WHITE, TFT_BLACK);
+	// centre the label, "N+", 12 pixels per character
+	int width = (minRating < 10 ? 2 : 3) * 12;
+	tft.setCursor(SIDEBAR_X + (SIDEBAR_WIDTH - width)/2 + 1, RATING_BTN_Y + ZOOM_BTN_HEIGHT/2 - 7);
+	tft.print(minRating);
+	tft.print('+');
+}
+
+/*
+	Draws the button that opens search mode
+
+	Arguments:
+		N/A
+
+	Returns:
+		N/A
+*/
+void drawSearchButton() {
+	tft.drawRect(SIDEBAR_X, SEARCH_BTN_Y, SIDEBAR_WIDTH, ZOOM_BTN_HEIGHT, TFT_WHITE);
+	tft.setTextColor(TFT_WHITE, TFT_BLACK);
+	tft.setCursor(SIDEBAR_X + (SIDEBAR_WIDTH - 4*12)/2 + 1, SEARCH_BTN_Y + ZOOM_BTN_HEIGHT/2 - 7);
+	tft.print(F("Find"));
+}
+
+/*
+	Clears the sidebar, leaving the rating button to clear itself
+
+	Arguments:
+		N/A
+
+	Returns:
+		N/A
+*/
+void clearSidebar() {
+	tft.fillRect(SIDEBAR_X, 0, SIDEBAR_WIDTH, RATING_BTN_Y, TFT_BLACK);
+	tft.fillRect(SIDEBAR_X, ZOOM_IN_Y, SIDEBAR_WIDTH, DISPLAY_HEIGHT - ZOOM_IN_Y, TFT_BLACK);
+	perf.rects += 2;
+}
+
+/*
+	Draws every button of the sidebar; the minimap follows once the map
+	is drawn
+
+	Arguments:
+		N/A
+
+	Returns:
+		N/A
+*/
+void drawSidebar() {
+	resetMinimap();
+	hud_reset();
+	drawZoomButtons();
+	drawRatingButton();
+	drawSearchButton();
+}
+
+/*
+	Raises the rating filter by one, going back to showing every
+	restaurant after MAX_RATING, and redraws the dots if they are shown
+
+	Arguments:
+		N/A
+
+	Returns:
+		N/A
+*/
+void nextRating() {
+	// erase the dots of the old filter before the new filter is applied
+	if (isDrawn) {
+		reDrawDots();
+	}
+	minRating = minRating < MAX_RATING ? minRating + 1 : 0;
+	drawRatingButton();
+	if (isDrawn) {
+		restaurantDraw();
+	}
+}
+
+/*
+	Switches to another zoom level, keeping the cursor over the same
+	location if the map edges allow it, and redraws the map
+
+	Arguments:
+		newZoom (int): the zoom level to switch to, clamped to the levels available
+
+	Returns:
+		N/A
+*/
+void changeZoom(int newZoom) {
+	newZoom = constrain(newZoom, 0, NUM_ZOOM_LEVELS - 1);
+	if (newZoom == zoom) {
+		return;
+	}
+
+	// location under the cursor at the new level
+	int levelX = cursorMapX() >> newZoom;
+	int levelY = cursorMapY() >> newZoom;
+	zoom = newZoom;
+
+	yegCurrX = constrain(levelX - cursorX, 0, YEG_X_MAX);
+	yegCurrY = constrain(levelY - cursorY, 0, YEG_Y_MAX);
+	cursorX = constrain(levelX - yegCurrX, 0, CURSOR_X_MAX);
+	cursorY = constrain(levelY - yegCurrY, 0, CURSOR_Y_MAX);
+
+	// the dots of the old level are painted over
+	drawViewport();
+	isDrawn = false;
+}
+
+/*
+	Reads the touchscreen
+
+	Arguments:
+		screenX, screenY (int16_t&): set to the screen position touched
+
+	Returns:
+		true if the screen is being touched
+*/
+bool readTouch(int16_t& screenX, int16_t& screenY) {
+	TSPoint touch = ts.getPoint();
+
+	// reset pins after reading from touchscreen
+	pinMode(YP, OUTPUT); 
+	pinMode(XM, OUTPUT); 
+
+	// check that pressure is within acceptable
+	if (touch.z < MINPRESSURE || touch.z > MAXPRESSURE) {
+		return false;
+	}
+
+	// convert the touch to screen coordinates using the calibration data
+	screenX = map(touch.y, TS_MINX, TS_MAXX, DISPLAY_WIDTH - 1, 0);
+	screenY = map(touch.x, TS_MINY, TS_MAXY, DISPLAY_HEIGHT - 1, 0);
+	return true;
+}
+
+// search mode state: the query typed so far, the file holding the name
+// index and the last block of it read, and the matches found
+char searchQuery[NAME_KEY_LEN + 1];
+uint8_t searchLength = 0;
+File nameIndex;
+uint32_t indexBlock;
+RestDist searchResults[SEARCH_RESULTS];
+int searchCount = 0;
+
+/*
+	Reads bytes from the name index, counting the blocks it reads
+
+	Arguments:
+		pos (uint32_t): offset in the index file
+		buf (uint8_t*): where to put the bytes
+		len (uint8_t): number of bytes, not crossing a block boundary
+
+	Returns:
+		true if all len bytes were read
+*/
+bool readIndex(uint32_t pos, uint8_t* buf, uint8_t len) {
+	if (pos / SD_BLOCK_SIZE != indexBlock) {
+		indexBlock = pos / SD_BLOCK_SIZE;
+		perf.index_blocks++;
+	}
+	return sdread_file(nameIndex, pos, true, buf, len);
+}
+
+/*
+	Reads entry i of the name index, a key and a restaurant index
+
+	Arguments:
+		i (uint16_t): the entry, 0 for the alphabetically first name
+		entry (uint8_t*): NAME_ENTRY_SIZE bytes to hold it
+
+	Returns:
+		true if the entry was read
+*/
+bool readNameEntry(uint16_t i, uint8_t* entry) {
+	uint32_t pos = (uint32_t) (1 + i / NAME_LEAF_ENTRIES) * SD_BLOCK_SIZE
+		+ (i % NAME_LEAF_ENTRIES) * NAME_ENTRY_SIZE;
+	return readIndex(pos, entry, NAME_ENTRY_SIZE);
+}
+
+/*
+	Finds the first SEARCH_RESULTS names starting with searchQuery by
+	binary search, first over the first keys of the leaves in the header
+	block and then within one leaf, so a lookup reads two blocks of the
+	index, or three when its matches run on into the next leaf.  A read
+	of the index that fails ends the search with no results.
+
+	Arguments:
+		N/A
+
+	Returns:
+		N/A
+*/
+void lookupNames() {
+	searchCount = 0;
+	uint8_t entry[NAME_ENTRY_SIZE];
+	if (!readIndex(0, entry, NAME_HEADER_SIZE)) {
+		return;
+	}
+	uint16_t entries = entry[0] | (entry[1] << 8);
+	uint16_t leaves = entry[2] | (entry[3] << 8);
+
+	// the last leaf starting below the query holds the first match, or
+	// the first match starts the leaf after it
+	int leaf = 0;
+	int lo = 0, hi = leaves - 1;
+	while (lo <= hi) {
+		int mid = (lo + hi) / 2;
+		if (!readIndex(NAME_HEADER_SIZE + mid * NAME_KEY_LEN, entry, NAME_KEY_LEN)) {
+			return;
+		}
+		if (memcmp(entry, searchQuery, searchLength) < 0) {
+			leaf = mid;
+			lo = mid + 1;
+		} else {
+			hi = mid - 1;
+		}
+	}
+
+	// first entry of the leaf not below the query
+	uint16_t first = leaf * NAME_LEAF_ENTRIES;
+	uint16_t last = min(entries, first + NAME_LEAF_ENTRIES);
+	while (first < last) {
+		uint16_t mid = (first + last) / 2;
+		if (!readNameEntry(mid, entry)) {
+			return;
+		}
+		if (memcmp(entry, searchQuery, searchLength) < 0) {
+			first = mid + 1;
+		} else {
+			last = mid;
+		}
+	}
+
+	for (uint16_t i = first; i < entries && searchCount < SEARCH_RESULTS; i++) {
+		if (!readNameEntry(i, entry) || memcmp(entry, searchQuery, searchLength) != 0) {
+			break;
+		}
+		searchResults[searchCount].index = entry[NAME_KEY_LEN] | (entry[NAME_KEY_LEN + 1] << 8);
+		searchResults[searchCount].dist = 0;
+		searchCount++;
+	}
+}
+
+/*
+	Prints one search result in its row, the first one highlighted as the
+	one the joystick button picks; a RestDeliver for fetchRestaurants()
+
+	Arguments:
+		slot (int): place of the restaurant in the results
+		pos (RestPos&): unused
+		name (const char*): name of the restaurant
+		context (void*): unused
+
+	Returns:
+		N/A
+*/
+void displaySearchResult(int slot, const RestPos& pos, const char* name, void* context) {
+	tft.setCursor(0, RESULTS_Y + 16*slot);
+	if (slot != 0) {
+		tft.setTextColor(TFT_WHITE, TFT_BLACK);
+	} else {
+		tft.setTextColor(TFT_BLACK, TFT_WHITE);
+	}
+	perf.chars += tft.print(name);
+}
+
+/*
+	Looks up the query and redraws it and its matches; with
+	-DREPORT_SEARCH_TIMES the time taken and the blocks read are printed,
+	the latency of one keystroke
+
+	Arguments:
+		N/A
+
+	Returns:
+		N/A
+*/
+void updateSearch() {
+#ifdef REPORT_SEARCH_TIMES
+	uint32_t start = millis();
+	uint32_t startIndexBlocks = perf.index_blocks;
+	uint32_t startRestBlocks = perf.rest_blocks;
+#endif
+
+	lookupNames();
+
+	tft.fillRect(0, 0, DISPLAY_WIDTH, KEYBOARD_Y, TFT_BLACK);
+	perf.rects++;
+	tft.setCursor(0, 0);
+	tft.setTextColor(TFT_WHITE, TFT_BLACK);
+	tft.print(F("Find: "));
+	tft.print(searchQuery);
+	tft.print('_');
+	fetchRestaurants(searchResults, searchCount, REST_FIELD_NAME, displaySearchResult, NULL);
+
+#ifdef REPORT_SEARCH_TIMES
+	Serial.print(F("search '"));
+	Serial.print(searchQuery);
+	Serial.print(F("': "));
+	Serial.print(millis() - start);
+	Serial.print(F(" ms, "));
+	Serial.print(perf.index_blocks - startIndexBlocks);
+	Serial.print(F(" index blocks, "));
+	Serial.print(perf.rest_blocks - startRestBlocks);
+	Serial.println(F(" restaurant blocks"));
+#endif
+}
+
+/*
+	Finds the word shown on a key instead of its character
+
+	Arguments:
+		key (char): the key, as in keyboardKeys
+
+	Returns:
+		the word in flash, or NULL if the key shows its character
+*/
+const char* keyLabel(char key) {
+	for (uint8_t i = 0; i < sizeof(keyLabels) / sizeof(keyLabels[0]); i++) {
+		if (pgm_read_byte(&keyLabels[i].key) == key) {
+			return keyLabels[i].label;
+		}
+	}
+	return NULL;
+}
+
+/*
+	Draws the search mode keyboard
+
+	Arguments:
+		N/A
+
+	Returns:
+		N/A
+*/
+void drawKeyboard() {
+	tft.setTextColor(TFT_WHITE, TFT_BLACK);
+	for (int k = 0; k < KEY_ROWS*KEY_COLS; k++) {
+		char key = pgm_read_byte(&keyboardKeys[k]);
+		// keys repeated along the last row make one wide key
+		if (k % KEY_COLS > 0 && key == pgm_read_byte(&keyboardKeys[k - 1])) {
+			continue;
+		}
+		int width = 1;
+		while (k % KEY_COLS + width < KEY_COLS
+			&& pgm_read_byte(&keyboardKeys[k + width]) == key) {
+			width++;
+		}
+		int x = (k % KEY_COLS) * KEY_WIDTH;
+		int y = KEYBOARD_Y + (k / KEY_COLS) * KEY_HEIGHT;
+		tft.drawRect(x, y, width * KEY_WIDTH, KEY_HEIGHT, TFT_WHITE);
+
+		const char* label = keyLabel(key);
+		int labelWidth = label != NULL ? strlen_P(label) * 12 : 12;
+		tft.setCursor(x + (width * KEY_WIDTH - labelWidth)/2 + 1, y + KEY_HEIGHT/2 - 7);
+		if (label != NULL) {
+			tft.print((const __FlashStringHelper*) label);
+		} else {
+			tft.print(key);
+		}
+	}
+}
+
+/*
+	Search mode: names are typed on a touch keyboard and the restaurants
+	whose names start with what is typed are listed as it is typed.
+	Tapping a match, or pressing the joystick for the first one, picks it.
+
+	Arguments:
+		N/A
+
+	Returns:
+		restIndex (int): the restaurant picked, or -1 if none was
+*/
+int searchMode() {
+	nameIndex = SD.open(NAME_INDEX_FILE);
+	if (!nameIndex) {
+		Serial.println(F("No name index on the SD card"));
+		return -1;
+	}
+	indexBlock = 0xFFFFFFFF;
+	searchLength = 0;
+	searchQuery[0] = '\0';
+
+	tft.fillScreen(TFT_BLACK);
+	drawKeyboard();
+	updateSearch();
+
+	int chosen = -1;
+	bool done = false;
+	while (!done) {
+		recordTrace();
+		perf_poll();
+
+		// the joystick button picks the first match; it must be let go
+		// before returning so mode 0 does not take the press as well
+		if (digitalRead(JOYSTICK_SEL) == LOW) {
+			if (searchCount > 0) {
+				chosen = searchResults[0].index;
+			}
+			done = true;
+			while (digitalRead(JOYSTICK_SEL) == LOW) {}
+		}
+
+		int16_t x, y;
+		if (done || !readTouch(x, y)) {
+			continue;
+		}
+		if (y >= KEYBOARD_Y) {
+			int col = constrain(x / KEY_WIDTH, 0, KEY_COLS - 1);
+			int row = constrain((y - KEYBOARD_Y) / KEY_HEIGHT, 0, KEY_ROWS - 1);
+			char key = pgm_read_byte(&keyboardKeys[row*KEY_COLS + col]);
+			if (key == KEY_EXIT) {
+				done = true;
+			} else if (key == KEY_DELETE) {
+				if (searchLength > 0) {
+					searchQuery[--searchLength] = '\0';
+					updateSearch();
+				}
+			} else if (searchLength < NAME_KEY_LEN) {
+				searchQuery[searchLength++] = key;
+				searchQuery[searchLength] = '\0';
+				updateSearch();
+			}
+		} else if (y >= RESULTS_Y && y < RESULTS_Y + 16*searchCount) {
+			chosen = searchResults[(y - RESULTS_Y) / 16].index;
+			done = true;
+		}
+
+		// one key per touch: wait for the finger to lift
+		while (readTouch(x, y)) {}
+	}
+
+	nameIndex.close();
+	return chosen;
+}
+
+/*
+	Process touchscreen input
+
+	Arguments:
+		N/A
+
+	Returns:
+		N/A
+*/
+void processTouch() {
+	int16_t screenX, screenY;
+	if (!readTouch(screenX, screenY)) {
+		// not touched, exit the function
+		return;
+	}
+
+	// touches in the sidebar only matter on the buttons
+	if (screenX >= SIDEBAR_X) {
+		if (screenY >= ZOOM_OUT_Y) {
+			changeZoom(zoom + 1);
+		} else if (screenY >= ZOOM_IN_Y) {
+			changeZoom(zoom - 1);
+		} else if (screenY >= RATING_BTN_Y) {
+			nextRating();
+		} else if (screenY >= SEARCH_BTN_Y) {
+			int restIndex = searchMode();
+			// search mode used the whole screen; the map area is covered
+			// by the viewport drawn below
+			clearSidebar();
+			drawSidebar();
+			isDrawn = false;
+			if (restIndex >= 0) {
+				centerOnRestaurant(restIndex);
+			} else {
+				drawViewport();
+			}
+		} else {
+			// the minimap draws the cursor itself
+			jumpToMinimap(screenX, screenY);
+			return;
+		}
+		redrawCursor(TFT_RED);
+		return;
+	}
+
+	// a touch near a dot selects its restaurant; any other touch shows
+	// or hides the dots
+	if (isDrawn && touchDot(screenX, screenY)) {
+		return;
+	}
+
+	// if dots are not drawn, draw them
+	// if dots are drawn, erase them and redraw map sections
+	if (!isDrawn) {
+		restaurantDraw();
+		isDrawn = true;
+	} else {
+		reDrawDots();
+		isDrawn = false;
+	}
+
+	redrawCursor(TFT_RED);
+}
+
+// state of the mode 0 joystick pipeline
+struct JoyInput {
+	int16_t filtX, filtY; // smoothed readings, offset from JOY_CENTER
+	int32_t moveX, moveY; // cursor movement not yet applied, 1/256 pixels
+	uint32_t lastSample; // millis() of the last sample
+	uint32_t lastFrame; // millis() the last movement was applied
+};
+JoyInput joyInput = {0, 0, 0, 0, 0, 0};
+
+/*
+	Reads one joystick axis, averaging JOY_OVERSAMPLE readings when the
+	first is outside the dead zone so a stick at rest costs one read
+
+	Arguments:
+		pin (uint8_t): the analog pin of the axis
+
+	Returns:
+		the reading, offset from JOY_CENTER
+*/
+int16_t readJoyAxis(uint8_t pin) {
+	int16_t value = analogRead(pin) - JOY_CENTER;
+	if (abs(value) <= JOY_DEADZONE) {
+		return value;
+	}
+	for (int i = 1; i < JOY_OVERSAMPLE; i++) {
+		value += analogRead(pin) - JOY_CENTER;
+	}
+	return value / JOY_OVERSAMPLE;
+}
+
+/*
+	Turns a smoothed joystick reading into a cursor speed
+
+	Arguments:
+		value (int16_t): the reading, offset from JOY_CENTER
+
+	Returns:
+		the speed in 1/256 pixels per millisecond, signed as value is; 0
+		in the dead zone
+*/
+int32_t joySpeed(int16_t value) {
+	int32_t push = abs(value) - JOY_DEADZONE;
+	if (push <= 0) {
+		return 0;
+	}
+	push = min(push, (int32_t) JOY_RANGE);
+	int32_t speed = JOY_MIN_SPEED
+		+ (JOY_MAX_SPEED - JOY_MIN_SPEED) * push * push / (JOY_RANGE * JOY_RANGE);
+	speed = speed * 256 / 1000;
+	return value < 0 ? -speed : speed;
+}
+
+/*
+	Takes a joystick sample, filtering it and adding the movement it
+	asks for since the last sample to what is waiting to be applied
+
+	Arguments:
+		N/A
+
+	Returns:
+		N/A
+*/
+void sampleJoystick() {
+	uint32_t now = millis();
+	// a long gap means the joystick was not being watched; do not let
+	// it turn into one big jump
+	uint32_t elapsed = min(now - joyInput.lastSample, (uint32_t) 2*JOY_FRAME_MS);
+	joyInput.lastSample = now;
+
+	// half of each new sample goes into the smoothed readings
+	joyInput.filtX = (joyInput.filtX + readJoyAxis(JOYSTICK_HORIZ)) / 2;
+	joyInput.filtY = (joyInput.filtY + readJoyAxis(JOYSTICK_VERT)) / 2;
+
+	// the horizontal axis is mounted the other way round
+	int32_t speedX = -joySpeed(joyInput.filtX);
+	int32_t speedY = joySpeed(joyInput.filtY);
+	// letting go drops any part of a pixel still waiting
+	joyInput.moveX = speedX == 0 ? 0 : joyInput.moveX + speedX * (int32_t) elapsed;
+	joyInput.moveY = speedY == 0 ? 0 : joyInput.moveY + speedY * (int32_t) elapsed;
+}
+
+/* 
+	Processes joystick input for mode 0: samples the joystick and, once a
+	frame, moves the cursor by all the samples since the last frame asked
+	for, redrawing it once
+
+	Arguments: 
+		N/A
+
+	Returns: 
+		N/A
+*/
+void joystickMode0() {
+    sampleJoystick();
+    if (millis() - joyInput.lastFrame < JOY_FRAME_MS) {
+      delay(JOY_SAMPLE_MS);
+      return;
+    }
+    joyInput.lastFrame = millis();
+
+    // stores the previous position of the cursor
+    prevX = cursorX;
+    prevY = cursorY;
+
+    // apply the whole pixels of the movement, keeping the rest
+    int dx = joyInput.moveX / 256;
+    int dy = joyInput.moveY / 256;
+    joyInput.moveX -= (int32_t) dx * 256;
+    joyInput.moveY -= (int32_t) dy * 256;
+    cursorX += dx;
+    cursorY += dy;
+
+    // constrains cursor position to within the map patch displayed
+    cursorX = constrain(cursorX, 0, CURSOR_X_MAX);
+    cursorY = constrain(cursorY, 0, CURSOR_Y_MAX);
+
+    bool turned = true;
+    if (cursorX == CURSOR_X_MAX && yegCurrX < YEG_X_MAX) {
+    	drawNextPatch(1, 0);
+    } else if (cursorX == 0 && yegCurrX > 0) {
+    	drawNextPatch(-1, 0);
+    } else if (cursorY == 0 && yegCurrY > 0) {
+    	drawNextPatch(0, -1);
+    } else if (cursorY == CURSOR_Y_MAX && yegCurrY < YEG_Y_MAX) {
+    	drawNextPatch(0, 1);
+    } else {
+    	turned = false;
+    }
+
+	// only redraws the map and dots the cursor has left and the cursor
+	// itself if the cursor position has changed; this is to prevent
+	// "flickering".  After a page turn the map is all new, so only the
+	// cursor is left to draw.
+	if (turned) {
+	  markCursor();
+	} else if (prevX != cursorX || prevY != cursorY) {
+	  markDirty(prevX - CURSOR_SIZE/2, prevY - CURSOR_SIZE/2, CURSOR_SIZE, CURSOR_SIZE);
+	  markCursor();
+	}
+	composeFrame();
+    delay(JOY_SAMPLE_MS);
+}
+
+/*
+	Finds the restaurants rated at least minRating on the part of the map
+	on screen
+
+	Arguments:
+		visit (RestVisit): called with each restaurant found
+		context (void*): passed on to visit
+
+	Returns:
+		N/A
+*/
+void queryViewport(RestVisit visit, void* context) {
+	queryRect(yegCurrX << zoom, yegCurrY << zoom,
+		((yegCurrX + min(MAP_DISP_WIDTH, LEVEL_WIDTH)) << zoom) - 1,
+		((yegCurrY + min(MAP_DISP_HEIGHT, LEVEL_HEIGHT)) << zoom) - 1,
+		visit, context);
+}
+
+// a rectangle of the screen
+struct ScreenRect {
+	int16_t x, y, w, h;
+};
+
+// a dot or cluster marker drawn over the map
+struct DotSprite {
+	int16_t x, y; // centre on the screen
+	uint8_t count; // 0 for a dot, else the count shown by a marker
+	uint16_t rest; // the restaurant of a dot
+};
+
+// the dots and markers drawn by restaurantDraw(); overflow is set when
+// there were more than DOT_SPRITES of them
+struct DotSprites {
+	DotSprite sprite[DOT_SPRITES];
+	uint8_t count;
+	bool overflow;
+};
+DotSprites dotSprites;
+
+// what restaurantDraw() and reDrawDots() work out about the dots on
+// screen
+struct DotLayer {
+	// restaurants in each CLUSTER_CELL square, saturating at 255
+	uint8_t counts[CLUSTER_COLS * CLUSTER_ROWS];
+	// DOT_CELL squares already holding a dot, see dotPosition()
+	uint8_t cells[(DOT_CELLS_X * DOT_CELLS_Y + 7) / 8];
+	// when set, drawDot() only draws dots touching this rectangle
+	const ScreenRect* clip;
+};
+
+// the dot functions check one out while they find the dots; under it
+// reDrawDots() draws map patches, a tile at most, and the queries read
+// restaurants without the flash table
+SCRATCH_ASSERT_FITS(SCRATCH_ROUND(sizeof(DotLayer))
+	+ LCD_TILE_SIZE * LCD_TILE_SIZE * 2);
+SCRATCH_ASSERT_FITS(SCRATCH_ROUND(sizeof(DotLayer)) + 2 * sizeof(Restaurant));
+
+/*
+	Finds whether two rectangles of the screen overlap
+
+	Arguments:
+		a, b (ScreenRect&): the rectangles
+
+	Returns:
+		true if they share a pixel
+*/
+bool rectsOverlap(const ScreenRect& a, const ScreenRect& b) {
+	return a.x < b.x + b.w && b.x < a.x + a.w
+		&& a.y < b.y + b.h && b.y < a.y + a.h;
+}
+
+/*
+	Remembers a dot or marker drawn by restaurantDraw() for the compositor
+	and touchDot()
+
+	Arguments:
+		x, y (int16_t): its centre on the screen
+		count (uint8_t): 0 for a dot, else the count shown by a marker
+		rest (uint16_t): the restaurant of a dot, unused for a marker
+
+	Returns:
+		N/A
+*/
+void addDotSprite(int16_t x, int16_t y, uint8_t count, uint16_t rest) {
+	if (dotSprites.count == DOT_SPRITES) {
+		dotSprites.overflow = true;
+		return;
+	}
+	DotSprite& sprite = dotSprites.sprite[dotSprites.count++];
+	sprite.x = x;
+	sprite.y = y;
+	sprite.count = count;
+	sprite.rest = rest;
+}
+
+/*
+	Finds where the dot for a restaurant goes on the screen and whether it
+	fits in the map area
+
+	Arguments:
+		rest (RestPos&): the restaurant's position
+		x, y (int&): set to the screen position of the dot
+
+	Returns:
+		true if the dot is on screen
+*/
+bool dotOnScreen(const RestPos& rest, int& x, int& y) {
+	x = (rest.x >> zoom) - yegCurrX;
+	y = (rest.y >> zoom) - yegCurrY;
+
+	// only draw the circles if the restaurant is within the map range
+	return x > 3 && x < min(MAP_DISP_WIDTH, LEVEL_WIDTH) - 3
+		&& y > 3 && y < min(MAP_DISP_HEIGHT, LEVEL_HEIGHT) - 3;
+}
+
+/*
+	Counts a restaurant in its CLUSTER_CELL square if its dot is on screen;
+	a RestVisit for the range queries
+
+	Arguments:
+		restIndex (uint16_t): unused
+		pos (RestPos&): the restaurant's position
+		context (void*): the DotLayer
+
+	Returns:
+		N/A
+*/
+void countDot(uint16_t restIndex, const RestPos& pos, void* context) {
+	DotLayer* layer = (DotLayer*) context;
+	int x, y;
+	if (dotOnScreen(pos, x, y)) {
+		uint8_t& count = layer->counts[(y / CLUSTER_CELL) * CLUSTER_COLS + x / CLUSTER_CELL];
+		if (count < 255) {
+			count++;
+		}
+	}
+}
+
+/*
+	Finds where the dot for a restaurant goes on the screen and whether it
+	is shown. A dot is shown if it fits in the map area, its CLUSTER_CELL
+	square is not drawn as a cluster and, when zoomed out, no earlier dot
+	landed in the same DOT_CELL square, so dense areas do not become solid
+	blue.
+
+	Arguments:
+		rest (RestPos&): the restaurant's position
+		x, y (int&): set to the screen position of the dot
+		layer (DotLayer*): counts filled in by countDot(), and the DOT_CELL
+			bitmap, cleared before the first call
+
+	Returns:
+		true if the dot is shown
+*/
+bool dotPosition(const RestPos& rest, int& x, int& y, DotLayer* layer) {
+	if (!dotOnScreen(rest, x, y)) {
+		return false;
+	}
+	if (layer->counts[(y / CLUSTER_CELL) * CLUSTER_COLS + x / CLUSTER_CELL] >= CLUSTER_MIN) {
+		return false;
+	}
+	if (zoom == 0) {
+		return true;
+	}
+
+	int cell = (y / DOT_CELL) * DOT_CELLS_X + x / DOT_CELL;
+	if (layer->cells[cell / 8] & (1 << (cell % 8))) {
+		return false;
+	}
+	layer->cells[cell / 8] |= 1 << (cell % 8);
+	return true;
+}
+
+/*
+	Draws the dot of one restaurant if it is shown; a RestVisit for the
+	range queries
+
+	Arguments:
+		restIndex (uint16_t): the restaurant
+		pos (RestPos&): the restaurant's position
+		context (void*): the DotLayer
+
 	Returns:
 		N/A
 */
-void drawNextPatch(int xDirection, int yDirection) {
+void drawDot(uint16_t restIndex, const RestPos& pos, void* context) {
+	DotLayer* layer = (DotLayer*) context;
+	int x, y;
+	if (!dotPosition(pos, x, y, layer)) {
+		return;
+	}
+	if (layer->clip == NULL) {
+		addDotSprite(x, y, 0, restIndex);
+	} else {
+		ScreenRect dot = {(int16_t) (x - 3), (int16_t) (y - 3), 7, 7};
+		if (!rectsOverlap(dot, *layer->clip)) {
+			return;
+		}
+	}
+	tft.fillCircle(x, y, 3, TFT_BLUE);
+	perf.circles++;
+}
 
-	// adjusts the x position of the map patch drawn
-	yegCurrX = yegCurrX + MAP_DISP_WIDTH * (xDirection);
-	yegCurrX = constrain(yegCurrX, 0, YEG_X_MAX);
+/*
+	Draws the patch of the map under the dot of one restaurant if it is
+	shown; a RestVisit for the range queries
 
-	// adjusts the y position of the map patch drawn
-	yegCurrY = yegCurrY + MAP_DISP_HEIGHT * (yDirection);
-	yegCurrY = constrain(yegCurrY, 0, YEG_Y_MAX);
+	Arguments:
+		as for drawDot()
 
-	// set the cursor to display in the middle of the screen
-	cursorX = MAP_DISP_WIDTH/2;
-	cursorY = MAP_DISP_HEIGHT/2;
+	Returns:
+		N/A
+*/
+void eraseDot(uint16_t restIndex, const RestPos& pos, void* context) {
+	int x, y;
+	if (dotPosition(pos, x, y, (DotLayer*) context)) {
+		// draw the patch of the map covering the circle
+		lcd_image_draw(&yegLevels[zoom], &tft, 
+			   yegCurrX + x - 3, yegCurrY + y - 3,
+			   x - 3, y - 3,
+			   7, 7);
+		perf.dot_erases++;
+	}
+}
 
-	// draws next patch
-	lcd_image_draw(&yegImage, &tft, 
-				   yegCurrX, yegCurrY,
-				   0, 0,
-				   MAP_DISP_WIDTH, MAP_DISP_HEIGHT);
+/*
+	Draws one cluster marker
+
+	Arguments:
+		x, y (int16_t): its centre on the screen
+		count (uint8_t): the restaurants it stands for
 
+	Returns:
+		N/A
+*/
+void drawMarker(int16_t x, int16_t y, uint8_t count) {
+	tft.fillCircle(x, y, CLUSTER_RADIUS, TFT_BLUE);
+	perf.circles++;
+	perf.markers++;
+
+	// up to three characters, centred
+	int digits = count > 99 ? 3 : (count > 9 ? 2 : 1);
+	tft.setCursor(x - 3*digits + 1, y - 3);
+	tft.setTextColor(TFT_WHITE);
+	tft.setTextSize(1);
+	if (count > 99) {
+		perf.chars += tft.print(F("99+"));
+	} else {
+		perf.chars += tft.print(count);
+	}
+	tft.setTextSize(SKETCH_TEXT_SIZE);
 }
 
 /*
-	Draws a new patch of the map based on the cursor position
+	Draws or erases the cluster markers, one in the middle of each
+	CLUSTER_CELL square holding CLUSTER_MIN or more restaurants, kept
+	inside the map area.  With a clip set only the markers touching it
+	are drawn, as drawDot() does with the dots.
+
+	Arguments:
+		layer (DotLayer*): counts filled in by countDot(), and the clip
+		erase (bool): true to draw the map back over the markers
+
+	Returns:
+		N/A
+*/
+void clusterMarkers(DotLayer* layer, bool erase) {
+	int16_t maxX = min(MAP_DISP_WIDTH, LEVEL_WIDTH) - CLUSTER_RADIUS - 1;
+	int16_t maxY = min(MAP_DISP_HEIGHT, LEVEL_HEIGHT) - CLUSTER_RADIUS - 1;
+	for (int cell = 0; cell < CLUSTER_COLS * CLUSTER_ROWS; cell++) {
+		uint8_t count = layer->counts[cell];
+		if (count < CLUSTER_MIN) {
+			continue;
+		}
+		int16_t x = min((cell % CLUSTER_COLS) * CLUSTER_CELL + CLUSTER_CELL/2, maxX);
+		int16_t y = min((cell / CLUSTER_COLS) * CLUSTER_CELL + CLUSTER_CELL/2, maxY);
+		if (erase) {
+			lcd_image_draw(&yegLevels[zoom], &tft,
+				yegCurrX + x - CLUSTER_RADIUS, yegCurrY + y - CLUSTER_RADIUS,
+				x - CLUSTER_RADIUS, y - CLUSTER_RADIUS,
+				2*CLUSTER_RADIUS + 1, 2*CLUSTER_RADIUS + 1);
+			perf.dot_erases++;
+			continue;
+		}
+		if (layer->clip != NULL) {
+			ScreenRect box = {(int16_t) (x - CLUSTER_RADIUS), (int16_t) (y - CLUSTER_RADIUS),
+				2*CLUSTER_RADIUS + 1, 2*CLUSTER_RADIUS + 1};
+			if (rectsOverlap(box, *layer->clip)) {
+				drawMarker(x, y, count);
+			}
+			continue;
+		}
+		drawMarker(x, y, count);
+		addDotSprite(x, y, count, 0);
+	}
+}
+
+/*
+	Counts the restaurants on screen in each CLUSTER_CELL square, the
+	first step of drawing or erasing the dots.  Only the grid index of the
+	flash table makes this cheap; reading every restaurant from the SD card
+	twice would cost more than the clusters save, so without it every
+	count stays 0 and each dot is drawn.
 
 	Arguments:
+		layer (DotLayer*): to be filled in
+
+	Returns:
+		N/A
+*/
+void countDots(DotLayer* layer) {
+	memset(layer, 0, sizeof(*layer));
+	if (restTableValid) {
+		queryViewport(countDot, layer);
+	}
+}
+
+/* 
+	Draws a point where each restaurant in range is located, or a marker
+	with the count where CLUSTER_MIN or more share a CLUSTER_CELL square
+
+	Arguments: 
 		N/A
 
 	Returns:
 		N/A
 */
-void selectedRestPatch() {
-	// get coordinates of selected restaurant
-	// then convert those lat/lon coordinates into x/y
-	Restaurant currentRest;
-	getRestaurant(rest_dist[selectedRest].index, &currentRest);
-	int32_t selectedLon = currentRest.lon;
-	int32_t selectedLat = currentRest.lat;
+void restaurantDraw() {
+	// the dots must not be painted over by the rest of a progressive draw
+	refineViewport(false);
+
+	uint32_t startBlocks = perf.rest_blocks;
+	dotSprites.count = 0;
+	dotSprites.overflow = false;
+	ScratchScope scope;
+	DotLayer* layer = scope.alloc<DotLayer>();
+	countDots(layer);
+	queryViewport(drawDot, layer);
+	clusterMarkers(layer, false);
+	reportRestBlocks(F("restaurantDraw"), startBlocks);
+}
+
+/* 
+	Redraws the map over the restaurant points and cluster markers,
+	visiting the restaurants in the same order as restaurantDraw() so the
+	same dots are found
+
+	Arguments: 
+		N/A
+
+	Returns:
+		N/A
+*/
+void reDrawDots() {
+	ScratchScope scope;
+	DotLayer* layer = scope.alloc<DotLayer>();
+	countDots(layer);
+	queryViewport(eraseDot, layer);
+	clusterMarkers(layer, true);
+}
+
+// the parts of the screen to redraw at the next composeFrame(): the map
+// under the dirty rectangles, the dots and markers over it, and the
+// cursor on top
+struct Frame {
+	ScreenRect dirty[DIRTY_RECTS];
+	uint8_t count;
+	bool cursor;
+};
+Frame frame;
+
+/*
+	Grows a rectangle to cover another as well
 
-	// values of coordinates on map from 0-2048
-	int currRestX = lon_to_x(selectedLon);
-	int currRestY = lat_to_y(selectedLat);
+	Arguments:
+		a (ScreenRect&): the rectangle to grow
+		b (ScreenRect&): the rectangle to cover
 
-	// define the middle width/height of display for use in the following functions
-	int dispMiddleWidth = MAP_DISP_WIDTH/2;
-	int dispMiddleHeight = MAP_DISP_HEIGHT/2;
+	Returns:
+		N/A
+*/
+void coverRect(ScreenRect& a, const ScreenRect& b) {
+	int16_t right = max(a.x + a.w, b.x + b.w);
+	int16_t bottom = max(a.y + a.h, b.y + b.h);
+	a.x = min(a.x, b.x);
+	a.y = min(a.y, b.y);
+	a.w = right - a.x;
+	a.h = bottom - a.y;
+}
 
-	// if x and y coordinates are within constraints (not too close to edges)
-	// 'normal' case
-	if ((currRestX > dispMiddleWidth) && (currRestX < MAP_WIDTH - dispMiddleWidth) 
-		&& (currRestY > dispMiddleHeight) && (currRestY < MAP_HEIGHT - dispMiddleHeight)) {
+/*
+	Marks part of the map area to be redrawn at the next composeFrame(),
+	along with the dots and markers over it.  Rectangles that overlap or
+	touch are merged so no pixel is drawn twice; once DIRTY_RECTS are
+	kept, a new one is merged with the last.
 
-		yegCurrX = currRestX - dispMiddleWidth;
-		yegCurrY = currRestY - dispMiddleHeight;
+	Arguments:
+		x, y, w, h (int16_t): the rectangle, clipped to the map shown
 
-		// draw cursor in middle of screen
-	    cursorX = dispMiddleWidth;
-	    cursorY = dispMiddleHeight;
+	Returns:
+		N/A
+*/
+void markDirty(int16_t x, int16_t y, int16_t w, int16_t h) {
+	int16_t right = min(x + w, min(MAP_DISP_WIDTH, LEVEL_WIDTH));
+	int16_t bottom = min(y + h, min(MAP_DISP_HEIGHT, LEVEL_HEIGHT));
+	x = max(x, 0);
+	y = max(y, 0);
+	if (right <= x || bottom <= y) {
+		return;
 	}
-	// if not in range of map
-	else if (currRestX < 0 || currRestX > MAP_WIDTH || currRestY < 0 || currRestY > MAP_HEIGHT) {
-		// location of cursor
-		if (currRestX < 0 || currRestX > MAP_WIDTH) {
-			cursorX = constrain(currRestX, 0, CURSOR_X_MAX) ;
+	ScreenRect rect = {x, y, (int16_t) (right - x), (int16_t) (bottom - y)};
+
+	// merging can make the rectangle reach others, so look again
+	bool merged;
+	do {
+		merged = false;
+		for (uint8_t i = 0; i < frame.count; i++) {
+			ScreenRect grown = frame.dirty[i];
+			grown.x--;
+			grown.y--;
+			grown.w += 2;
+			grown.h += 2;
+			if (rectsOverlap(grown, rect)) {
+				coverRect(rect, frame.dirty[i]);
+				frame.dirty[i] = frame.dirty[--frame.count];
+				merged = true;
+				break;
+			}
 		}
+	} while (merged);
+	if (frame.count == DIRTY_RECTS) {
+		coverRect(frame.dirty[DIRTY_RECTS - 1], rect);
+	} else {
+		frame.dirty[frame.count++] = rect;
+	}
+}
 
-		if (currRestY < 0 || currRestY > MAP_HEIGHT) {
-			cursorY = constrain(currRestY, 0, CURSOR_Y_MAX);
-		}
+/*
+	Marks the cursor to be drawn at the next composeFrame()
 
-		// draw map
-		yegCurrX = constrain(currRestX, 0, YEG_X_MAX);
-		yegCurrY = constrain(currRestY, 0, YEG_Y_MAX);
+	Arguments:
+		N/A
+
+	Returns:
+		N/A
+*/
+void markCursor() {
+	frame.cursor = true;
+}
+
+/*
+	Splits the part of a rectangle outside another into up to four
+	rectangles: the bands above and below, then the pieces left and right
+
+	Arguments:
+		a (ScreenRect&): the rectangle to split
+		b (ScreenRect&): the rectangle to take out of it
+		pieces (ScreenRect*): room for four rectangles
+
+	Returns:
+		the number of pieces
+*/
+uint8_t subtractRect(const ScreenRect& a, const ScreenRect& b, ScreenRect* pieces) {
+	if (!rectsOverlap(a, b)) {
+		pieces[0] = a;
+		return 1;
+	}
+	uint8_t count = 0;
+	int16_t top = max(a.y, b.y);
+	int16_t bottom = min(a.y + a.h, b.y + b.h);
+	if (a.y < top) {
+		pieces[count++] = ScreenRect{a.x, a.y, a.w, (int16_t) (top - a.y)};
+	}
+	if (bottom < a.y + a.h) {
+		pieces[count++] = ScreenRect{a.x, bottom, a.w, (int16_t) (a.y + a.h - bottom)};
 	}
-	// if the x coordinate is close to edges
-	else {
-		cursorX = constrain(currRestX, 0, CURSOR_X_MAX);
-		cursorY = constrain(currRestY, 0, CURSOR_Y_MAX);
+	if (a.x < b.x) {
+		pieces[count++] = ScreenRect{a.x, top, (int16_t) (b.x - a.x), (int16_t) (bottom - top)};
+	}
+	if (b.x + b.w < a.x + a.w) {
+		pieces[count++] = ScreenRect{(int16_t) (b.x + b.w), top,
+			(int16_t) (a.x + a.w - b.x - b.w), (int16_t) (bottom - top)};
+	}
+	return count;
+}
+
+/*
+	Redraws what was marked since the last frame, each layer once and in
+	order: the map under the dirty rectangles, leaving out what the cursor
+	will cover, then the dots and markers touching them, then the cursor
+	if it was marked or a dot was drawn over it.  With more dots than
+	DOT_SPRITES the ones to redraw are found again with the range queries
+	of the flash table; without it they are left off until the next touch.
+
+	Arguments:
+		N/A
 
-		yegCurrX = constrain(currRestX, 0, YEG_X_MAX);
-		yegCurrY = constrain(currRestY, 0, YEG_Y_MAX);
+	Returns:
+		N/A
+*/
+void composeFrame() {
+	ScreenRect cursor = {(int16_t) (cursorX - CURSOR_SIZE/2), (int16_t) (cursorY - CURSOR_SIZE/2),
+		CURSOR_SIZE, CURSOR_SIZE};
+	bool drawCursor = frame.cursor;
+
+	// map layer
+	uint32_t startBlocks = lcd_image_stats.blocks;
+	for (uint8_t i = 0; i < frame.count; i++) {
+		ScreenRect pieces[4];
+		uint8_t count = subtractRect(frame.dirty[i], cursor, pieces);
+		for (uint8_t j = 0; j < count; j++) {
+			lcd_image_draw(&yegLevels[zoom], &tft,
+				yegCurrX + pieces[j].x, yegCurrY + pieces[j].y,
+				pieces[j].x, pieces[j].y,
+				pieces[j].w, pieces[j].h);
+		}
+	}
+	if (frame.count > 0) {
+		reportBlocks(F("composeFrame"), startBlocks);
 	}
 
-	// draw the patch of the map with the restaurant located in the middle
-	lcd_image_draw(&yegImage, &tft, 
-				   yegCurrX, yegCurrY,
-				   0, 0,
-				   MAP_DISP_WIDTH, MAP_DISP_HEIGHT);	
+	// dot layer
+	if (isDrawn && frame.count > 0) {
+		if (!dotSprites.overflow) {
+			for (uint8_t i = 0; i < dotSprites.count; i++) {
+				const DotSprite& sprite = dotSprites.sprite[i];
+				int16_t radius = sprite.count ? CLUSTER_RADIUS : 3;
+				ScreenRect box = {(int16_t) (sprite.x - radius), (int16_t) (sprite.y - radius),
+					(int16_t) (2*radius + 1), (int16_t) (2*radius + 1)};
+				for (uint8_t j = 0; j < frame.count; j++) {
+					if (!rectsOverlap(box, frame.dirty[j])) {
+						continue;
+					}
+					if (sprite.count) {
+						drawMarker(sprite.x, sprite.y, sprite.count);
+					} else {
+						tft.fillCircle(sprite.x, sprite.y, 3, TFT_BLUE);
+						perf.circles++;
+					}
+					drawCursor = drawCursor || rectsOverlap(box, cursor);
+					break;
+				}
+			}
+		} else if (restTableValid) {
+			ScreenRect clip = frame.dirty[0];
+			for (uint8_t i = 1; i < frame.count; i++) {
+				coverRect(clip, frame.dirty[i]);
+			}
+			ScratchScope scope;
+			DotLayer* layer = scope.alloc<DotLayer>();
+			countDots(layer);
+			layer->clip = &clip;
+			queryViewport(drawDot, layer);
+			clusterMarkers(layer, false);
+			// a dot or marker drawn reaches no further than this past the
+			// clip, maybe onto the cursor
+			ScreenRect reach = {(int16_t) (clip.x - CLUSTER_RADIUS), (int16_t) (clip.y - CLUSTER_RADIUS),
+				(int16_t) (clip.w + 2*CLUSTER_RADIUS), (int16_t) (clip.h + 2*CLUSTER_RADIUS)};
+			drawCursor = drawCursor || rectsOverlap(reach, cursor);
+		}
+	}
 
-	// draw cursor
-	redrawCursor(TFT_RED);
+	// cursor layer
+	if (drawCursor) {
+		redrawCursor(TFT_RED);
+	}
+	frame.count = 0;
+	frame.cursor = false;
 }
 
-// forward declaration
-void restaurantDraw();
-void reDrawDots();
+// what touchDot() looks for: the dot nearest a touch on the screen
+struct DotHit {
+	DotLayer* layer;
+	int16_t x, y; // the touch
+	int32_t best; // squared distance to the nearest dot yet
+	int16_t dotX, dotY; // where that dot is
+	uint16_t rest; // and its restaurant
+};
+
+// the restaurant of the last dot touched and the map point the cursor
+// was put on for it; it heads the nearest list while the cursor stays
+// there, rest being -1 before any dot is touched
+struct TouchedRest {
+	int rest;
+	int16_t x, y;
+};
+TouchedRest touched = {-1, 0, 0};
 
 /*
-	Process touchscreen input
+	Keeps a dot if it is nearer the touch than any found so far
 
 	Arguments:
+		hit (DotHit*): the search
+		x, y (int): the centre of a dot shown on screen
+		rest (uint16_t): its restaurant
+
+	Returns:
 		N/A
+*/
+void nearerDot(DotHit* hit, int x, int y, uint16_t rest) {
+	int32_t dx = x - hit->x;
+	int32_t dy = y - hit->y;
+	int32_t dist = dx*dx + dy*dy;
+	if (dist < hit->best) {
+		hit->best = dist;
+		hit->dotX = x;
+		hit->dotY = y;
+		hit->rest = rest;
+	}
+}
+
+/*
+	Tests the dot of one restaurant against a touch if it is shown; a
+	RestVisit for the range queries
+
+	Arguments:
+		restIndex (uint16_t): the restaurant
+		pos (RestPos&): the restaurant's position
+		context (void*): the DotHit
 
 	Returns:
 		N/A
 */
-void processTouch() {
-	TSPoint touch = ts.getPoint();
+void hitDot(uint16_t restIndex, const RestPos& pos, void* context) {
+	DotHit* hit = (DotHit*) context;
+	int x, y;
+	if (dotPosition(pos, x, y, hit->layer)) {
+		nearerDot(hit, x, y, restIndex);
+	}
+}
 
-	// reset pins after reading from touchscreen
-	pinMode(YP, OUTPUT); 
-	pinMode(XM, OUTPUT); 
+/*
+	Moves the restaurant of the last dot touched to the head of the
+	nearest list, where mode1 selects it, if the cursor is still where
+	the touch put it.  Zoomed out, the cursor's map point is only within
+	a few pixels of the restaurant, more for a dot by the edge, so a
+	neighbour or a restaurant whose dot was left out could otherwise rank
+	first.
 
-	// check that pressure is within acceptable
-	if (touch.z < MINPRESSURE || touch.z > MAXPRESSURE) {
-		// if it is not, exit the function
+	Arguments:
+		N/A
+
+	Returns:
+		N/A
+*/
+void putTouchedFirst() {
+	if (touched.rest < 0 || touched.x != cursorMapX() || touched.y != cursorMapY()) {
 		return;
 	}
-	// if dots are not drawn, draw them
-	// if dots are drawn, erase them and redraw map sections
-	if (!isDrawn) {
-		restaurantDraw();
-		isDrawn = true;
+	for (int i = 0; i < restCount; i++) {
+		if (rest_dist[i].index == touched.rest) {
+			RestDist picked = rest_dist[i];
+			for (; i > 0; i--) {
+				rest_dist[i] = rest_dist[i-1];
+			}
+			rest_dist[0] = picked;
+			return;
+		}
+	}
+}
+
+/*
+	Selects the restaurant whose dot is nearest a touch on the map, if one
+	is shown within TOUCH_RADIUS pixels of it: the cursor moves onto the
+	dot and the restaurant is remembered, so that putTouchedFirst() has
+	it head the list, selected, when the joystick is pressed.  The dots
+	remembered by
+	restaurantDraw() are searched when there are few enough of them;
+	otherwise the dots are found again as drawDot() found them, querying
+	only the DOT_CELL squares around the touch: whether a dot is shown
+	depends on the whole cluster counts but only on earlier dots in its
+	own square.  With the flash table either takes a few grid cells and no
+	SD reads, well under a frame; without it the second reads every
+	restaurant's position.  Built with -DREPORT_TOUCH_TIMES the time the
+	search took is printed.
+
+	Arguments:
+		screenX, screenY (int16_t): the touch on the screen
+
+	Returns:
+		true if a dot was touched
+*/
+bool touchDot(int16_t screenX, int16_t screenY) {
+	if (screenX >= min(MAP_DISP_WIDTH, LEVEL_WIDTH)
+		|| screenY >= min(MAP_DISP_HEIGHT, LEVEL_HEIGHT)) {
+		return false;
+	}
+#ifdef REPORT_TOUCH_TIMES
+	uint32_t start = micros();
+#endif
+
+	DotHit hit = {NULL, screenX, screenY, (int32_t) TOUCH_RADIUS*TOUCH_RADIUS + 1, 0, 0, 0};
+	if (!dotSprites.overflow) {
+		for (uint8_t i = 0; i < dotSprites.count; i++) {
+			const DotSprite& sprite = dotSprites.sprite[i];
+			if (sprite.count == 0) {
+				nearerDot(&hit, sprite.x, sprite.y, sprite.rest);
+			}
+		}
 	} else {
-		reDrawDots();
-		isDrawn = false;
+		ScratchScope scope;
+		hit.layer = scope.alloc<DotLayer>();
+		countDots(hit.layer);
+		int16_t x0 = max(screenX - TOUCH_RADIUS, 0) / DOT_CELL * DOT_CELL;
+		int16_t y0 = max(screenY - TOUCH_RADIUS, 0) / DOT_CELL * DOT_CELL;
+		int16_t x1 = (screenX + TOUCH_RADIUS) / DOT_CELL * DOT_CELL + DOT_CELL;
+		int16_t y1 = (screenY + TOUCH_RADIUS) / DOT_CELL * DOT_CELL + DOT_CELL;
+		queryRect((yegCurrX + x0) << zoom, (yegCurrY + y0) << zoom,
+			((yegCurrX + x1) << zoom) - 1, ((yegCurrY + y1) << zoom) - 1,
+			hitDot, &hit);
 	}
 
-	redrawCursor(TFT_RED);
+#ifdef REPORT_TOUCH_TIMES
+	Serial.print(dotSprites.overflow ? F("touch queried in ") : F("touch matched in "));
+	Serial.print(micros() - start);
+	Serial.println(F(" us"));
+#endif
+	if (hit.best > (int32_t) TOUCH_RADIUS*TOUCH_RADIUS) {
+		return false;
+	}
+
+	// kept off the edges, where the cursor would turn the page, so a dot
+	// there is a pixel or two off; the restaurant picked is exact either
+	// way.  A touch held on the dot the cursor is on draws nothing.
+	int16_t x = constrain(hit.dotX, 1, CURSOR_X_MAX - 1);
+	int16_t y = constrain(hit.dotY, 1, CURSOR_Y_MAX - 1);
+	if (x != cursorX || y != cursorY) {
+		markDirty(cursorX - CURSOR_SIZE/2, cursorY - CURSOR_SIZE/2, CURSOR_SIZE, CURSOR_SIZE);
+		cursorX = x;
+		cursorY = y;
+		markCursor();
+		composeFrame();
+	}
+	touched.rest = hit.rest;
+	touched.x = cursorMapX();
+	touched.y = cursorMapY();
+	return true;
 }
 
-/* 
-	Processes joystick input for mode 0
+lcd_image_t yegMini = {MINIMAP_FILE, MINIMAP_SIZE, MINIMAP_SIZE, LCD_ROW_MAJOR};
 
-	Arguments: 
-		N/A
+// the outline on the minimap, in its pixels; w is 0 while none is drawn
+// and -1 while the thumbnail is not drawn either
+ScreenRect minimapView = {0, 0, -1, 0};
 
-	Returns: 
+/*
+	Finds the part of the minimap covering the map on screen, at least
+	two pixels across so it stays visible
+
+	Arguments:
 		N/A
+
+	Returns:
+		the rectangle, in pixels of the minimap
 */
-void joystickMode0() {
-    int xVal = analogRead(JOYSTICK_HORIZ);
-    int yVal = analogRead(JOYSTICK_VERT);
+ScreenRect minimapViewport() {
+	int32_t x0 = (int32_t) yegCurrX << zoom;
+	int32_t y0 = (int32_t) yegCurrY << zoom;
+	int32_t x1 = (int32_t) (yegCurrX + min(MAP_DISP_WIDTH, LEVEL_WIDTH)) << zoom;
+	int32_t y1 = (int32_t) (yegCurrY + min(MAP_DISP_HEIGHT, LEVEL_HEIGHT)) << zoom;
+	ScreenRect view;
+	view.x = min(x0 * MINIMAP_SIZE / MAP_WIDTH, MINIMAP_SIZE - 2);
+	view.y = min(y0 * MINIMAP_SIZE / MAP_HEIGHT, MINIMAP_SIZE - 2);
+	view.w = max((x1 * MINIMAP_SIZE + MAP_WIDTH - 1) / MAP_WIDTH - view.x, (int32_t) 2);
+	view.h = max((y1 * MINIMAP_SIZE + MAP_HEIGHT - 1) / MAP_HEIGHT - view.y, (int32_t) 2);
+	view.w = min(view.w, MINIMAP_SIZE - view.x);
+	view.h = min(view.h, MINIMAP_SIZE - view.y);
+	return view;
+}
 
-    // stores the previous position of the cursor
-    prevX = cursorX;
-    prevY = cursorY;
+/*
+	Draws part of the minimap thumbnail
 
-    // change cursorX and cursorY when joystick is moved
-    if (yVal < (JOY_CENTER - JOY_DEADZONE)) {
-      if (yVal < (JOY_CENTER - JOY_DEADZONE - BUFFER)) {
-        cursorY -= 5;
-      }
-      cursorY -= 1;
-    }
-    else if (yVal > JOY_CENTER + JOY_DEADZONE) {
-      if (yVal > (JOY_CENTER + JOY_DEADZONE + BUFFER)) {
-        cursorY += 5;
-      }
-      cursorY += 1;
-    }
-    if (xVal > JOY_CENTER + JOY_DEADZONE) {
-      if (xVal > JOY_CENTER + JOY_DEADZONE + BUFFER) {
-        cursorX -= 5;
-      }
-      cursorX -= 1;
-    }
-    else if (xVal < JOY_CENTER - JOY_DEADZONE) {
-      if (xVal < JOY_CENTER - JOY_DEADZONE - BUFFER) {
-        cursorX += 5;
-      }
-      cursorX += 1;
-    }
+	Arguments:
+		x, y, w, h (int16_t): the part, in pixels of the minimap
 
-    // constrains cursor position to within the map patch displayed
-    cursorX = constrain(cursorX, 0, CURSOR_X_MAX);
-    cursorY = constrain(cursorY, 0, CURSOR_Y_MAX);
+	Returns:
+		N/A
+*/
+void drawMinimapPatch(int16_t x, int16_t y, int16_t w, int16_t h) {
+	lcd_image_draw(&yegMini, &tft, x, y, MINIMAP_X + x, MINIMAP_Y + y, w, h);
+}
 
-    if (cursorX == CURSOR_X_MAX && yegCurrX < YEG_X_MAX) {
-    	drawNextPatch(1, 0);
-    } else if (cursorX == 0 && yegCurrX > 0) {
-    	drawNextPatch(-1, 0);
-    } else if (cursorY == 0 && yegCurrY > 0) {
-    	drawNextPatch(0, -1);
-    } else if (cursorY == CURSOR_Y_MAX && yegCurrY < YEG_Y_MAX) {
-    	drawNextPatch(0, 1);
-    }
+/*
+	Moves the outline on the minimap to the map on screen if it has
+	changed, drawing the thumbnail back over the edges of the old outline
+	and then the edges of the new one; nothing inside either is drawn.
+	After resetMinimap() the whole thumbnail is drawn first.  Cheap
+	enough to call on every pass of mode 0 that is not refining the map.
 
-	// only redraws patch of Edmonton map if cursor position has changed
-	// this is to prevent "flickering"
-	if (prevX != cursorX || prevY != cursorY) {
-	  redrawMap();
-	}
+	Arguments:
+		N/A
 
-	// draw new cursor at new position
-	redrawCursor(TFT_RED);
-    delay(20);
+	Returns:
+		N/A
+*/
+void updateMinimap() {
+	ScreenRect view = minimapViewport();
+	if (view.x == minimapView.x && view.y == minimapView.y
+		&& view.w == minimapView.w && view.h == minimapView.h) {
+		return;
+	}
+	if (minimapView.w < 0) {
+		drawMinimapPatch(0, 0, MINIMAP_SIZE, MINIMAP_SIZE);
+	} else if (minimapView.w > 0) {
+		const ScreenRect& old = minimapView;
+		drawMinimapPatch(old.x, old.y, old.w, 1);
+		drawMinimapPatch(old.x, old.y + old.h - 1, old.w, 1);
+		drawMinimapPatch(old.x, old.y + 1, 1, old.h - 2);
+		drawMinimapPatch(old.x + old.w - 1, old.y + 1, 1, old.h - 2);
+	}
+	tft.drawRect(MINIMAP_X + view.x, MINIMAP_Y + view.y, view.w, view.h, MINIMAP_COLOUR);
+	minimapView = view;
 }
 
-/* 
-	Draws a point where each restaurant in range is located
+/*
+	Has the next updateMinimap() draw the whole minimap, once the sidebar
+	has been cleared
 
-	Arguments: 
+	Arguments:
 		N/A
 
 	Returns:
 		N/A
 */
-void restaurantDraw() {
-	// ensure rest_dist is populated
-	getRestDist(rest_dist, yegCurrX + cursorX, yegCurrY + cursorY);
-	for (int i = 0; i < NUM_RESTAURANTS; i++) {
-		Restaurant currentDrawRest;
-		// get latitude and longitude of each restaurant
-		getRestaurant(rest_dist[i].index, &currentDrawRest);
-		int32_t selectedDrawLon = currentDrawRest.lon;
-		int32_t selectedDrawLat = currentDrawRest.lat;
-		int currDrawRestX = lon_to_x(selectedDrawLon);
-		int currDrawRestY = lat_to_y(selectedDrawLat);
-		// only draw the circles if the restaurant is within the map range
-		if (currDrawRestX > yegCurrX + 3 && currDrawRestX < yegCurrX + MAP_DISP_WIDTH - 3
-			&& currDrawRestY > yegCurrY + 3 && currDrawRestY < yegCurrY + MAP_DISP_HEIGHT - 3) {
-			tft.fillCircle(currDrawRestX - yegCurrX, currDrawRestY - yegCurrY, 3, TFT_BLUE);
-		}		
-	}
+void resetMinimap() {
+	minimapView.w = -1;
 }
 
-/* 
-	Redraws the map over the restaurant points
+/*
+	Centres the map on the point of the minimap touched, as far as the
+	map edges allow, and puts the cursor over it.  The whole way is one
+	page draw, however far it is; when the point is already on screen
+	only the cursor moves.
 
-	Arguments: 
-		N/A
+	Arguments:
+		screenX, screenY (int16_t): the touch on the screen
 
 	Returns:
 		N/A
 */
-void reDrawDots() {
-	for (int i = 0; i < NUM_RESTAURANTS; i++) {
-		Restaurant currentDrawRest;
-		getRestaurant(rest_dist[i].index, &currentDrawRest);
-		int32_t selectedDrawLon = currentDrawRest.lon;
-		int32_t selectedDrawLat = currentDrawRest.lat;
-		int currDrawRestX = lon_to_x(selectedDrawLon);
-		int currDrawRestY = lat_to_y(selectedDrawLat);
-		if (currDrawRestX > yegCurrX + 3 && currDrawRestX < yegCurrX + MAP_DISP_WIDTH - 5
-			&& currDrawRestY > yegCurrY + 3 && currDrawRestY < yegCurrY + MAP_DISP_HEIGHT - 3) {
-			// draw the patch of the map covering the circle
-			lcd_image_draw(&yegImage, &tft, 
-				   currDrawRestX - 3, currDrawRestY - 3,
-				   currDrawRestX - yegCurrX - 3, currDrawRestY - yegCurrY - 3,
-				   7, 7);
-		}		
+void jumpToMinimap(int16_t screenX, int16_t screenY) {
+	if (screenX < MINIMAP_X || screenX >= MINIMAP_X + MINIMAP_SIZE
+		|| screenY < MINIMAP_Y || screenY >= MINIMAP_Y + MINIMAP_SIZE) {
+		return;
 	}
+
+	// the middle of the minimap pixel touched, on the level shown
+	int x = ((int32_t) (2*(screenX - MINIMAP_X) + 1) * MAP_WIDTH / (2*MINIMAP_SIZE)) >> zoom;
+	int y = ((int32_t) (2*(screenY - MINIMAP_Y) + 1) * MAP_HEIGHT / (2*MINIMAP_SIZE)) >> zoom;
+	int newX = constrain(x - MAP_DISP_WIDTH/2, 0, YEG_X_MAX);
+	int newY = constrain(y - MAP_DISP_HEIGHT/2, 0, YEG_Y_MAX);
+
+	// kept off the edges, where the cursor would turn the page
+	if (newX == yegCurrX && newY == yegCurrY) {
+		markDirty(cursorX - CURSOR_SIZE/2, cursorY - CURSOR_SIZE/2, CURSOR_SIZE, CURSOR_SIZE);
+		cursorX = constrain(x - yegCurrX, 1, CURSOR_X_MAX - 1);
+		cursorY = constrain(y - yegCurrY, 1, CURSOR_Y_MAX - 1);
+		markCursor();
+		composeFrame();
+		return;
+	}
+	yegCurrX = newX;
+	yegCurrY = newY;
+	cursorX = constrain(x - yegCurrX, 1, CURSOR_X_MAX - 1);
+	cursorY = constrain(y - yegCurrY, 1, CURSOR_Y_MAX - 1);
+	uint32_t startBlocks = lcd_image_stats.blocks;
+	drawViewport();
+	reportBlocks(F("jumpToMinimap"), startBlocks);
+	redrawCursor(TFT_RED);
 }
 
 /*
@@ -687,16 +3166,30 @@ void reDrawDots() {
 		N/A
 */ 
 void mode0() {
-	// clear screen
-	tft.fillScreen(TFT_BLACK);
+	// the map area is covered by the viewport drawn below, so only the
+	// sidebar needs clearing
+	clearSidebar();
+	drawSidebar();
 
 	selectedRestPatch();
 
     while (digitalRead(JOYSTICK_SEL) == HIGH) {
+    	recordTrace();
+    	perf_poll();
     	joystickMode0();
     	processTouch();
+    	// the map comes first; the minimap catches up once it is done
+    	if (!refinePending) {
+    		updateMinimap();
+    	}
+    	refineViewport(true);
+    	precomputeNearest();
+    	hud_draw(&tft, HUD_X, HUD_Y);
+    	hud_frame();
     }
+    recordTrace();
 
+    refinePending = false;
     isDrawn = false;
     selectedRest = 0;
     mode1();
@@ -735,18 +3228,27 @@ void setup() {
     	Serial.println("OK!");
     }
 
+    // holding the joystick button down at power on benchmarks the card
+    // on the map and restaurant data before starting as usual
+    if (digitalRead(JOYSTICK_SEL) == LOW) {
+      sdbench_run(&card, SD_CS, "yeg-big.lcd", REST_START_BLOCK,
+                  (NUM_RESTAURANTS + 7) / 8);
+    }
+
+    checkRestTable();
+    perf_set_command(sketchCommand);
+
     // sets to correct horizontal orientation
     tft.setRotation(1);
 
-    // resets display to all black
-    tft.fillScreen(TFT_BLACK);
+    // the display is not cleared here; mode0() covers all of it
 
     yegCurrX = YEG_MIDDLE_X;
     yegCurrY = YEG_MIDDLE_Y;
 
     // format text display
 	tft.setTextWrap(false);
-	tft.setTextSize(2);	
+	tft.setTextSize(SKETCH_TEXT_SIZE);
 }
 
 int main() {
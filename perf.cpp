@@ -0,0 +1,156 @@
+/*
+ * Always-on counters of the work done by the sketch, and a line-based
+ * Serial console for reading them from a running unit.
+ */
+
+#include <Arduino.h>
+#include "MCUFRIEND_kbv.h"
+
+#include "perf.h"
+#include "scratch.h"
+#include "sdread.h"
+
+// longest command accepted; longer lines are discarded whole
+#define PERF_LINE_MAX 15
+
+perf_counters_t perf;
+
+// totals at the most recent "snap"
+static perf_counters_t snap_perf;
+static lcd_image_stats_t snap_image;
+static sdread_stats_t snap_read;
+
+// handler for commands the console does not know itself
+static bool (*extra_command)(const char *line) = NULL;
+
+static char line[PERF_LINE_MAX + 1];
+static uint8_t line_len = 0;
+static bool line_overflow = false;
+
+static void print_counter(const __FlashStringHelper *name, uint32_t value) {
+  Serial.print(name);
+  Serial.println(value);
+}
+
+/* Prints every counter, less the matching counter of base if it is not
+ * NULL.  Counters only grow between resets, so the differences never wrap.
+ * sd_worst_us is a maximum rather than a count and is printed as it is.
+ */
+static void print_counters(const perf_counters_t *base_perf,
+                           const lcd_image_stats_t *base_image,
+                           const sdread_stats_t *base_read)
+{
+  perf_counters_t p = perf;
+  lcd_image_stats_t s = lcd_image_stats;
+  sdread_stats_t r = sdread_stats;
+  if (base_perf != NULL) {
+    p.rest_reads -= base_perf->rest_reads;
+    p.rest_blocks -= base_perf->rest_blocks;
+    p.index_blocks -= base_perf->index_blocks;
+    p.circles -= base_perf->circles;
+    p.markers -= base_perf->markers;
+    p.dot_erases -= base_perf->dot_erases;
+    p.list_hits -= base_perf->list_hits;
+    p.list_misses -= base_perf->list_misses;
+    p.pages -= base_perf->pages;
+    p.rects -= base_perf->rects;
+    p.chars -= base_perf->chars;
+    s.blocks -= base_image->blocks;
+    s.hits -= base_image->hits;
+    s.bytes -= base_image->bytes;
+    s.seeks -= base_image->seeks;
+    s.opens -= base_image->opens;
+    s.pixels -= base_image->pixels;
+    s.gaps -= base_image->gaps;
+    r.reads -= base_read->reads;
+    r.retries -= base_read->retries;
+    r.failures -= base_read->failures;
+  }
+
+  print_counter(F("img_blocks "), s.blocks);
+  print_counter(F("img_hits "), s.hits);
+  print_counter(F("img_bytes "), s.bytes);
+  print_counter(F("img_seeks "), s.seeks);
+  print_counter(F("img_opens "), s.opens);
+  print_counter(F("img_pixels "), s.pixels);
+  print_counter(F("img_gaps "), s.gaps);
+  print_counter(F("sd_reads "), r.reads);
+  print_counter(F("sd_retries "), r.retries);
+  print_counter(F("sd_failures "), r.failures);
+  print_counter(F("sd_worst_us "), r.worst_us);
+  print_counter(F("rest_reads "), p.rest_reads);
+  print_counter(F("rest_blocks "), p.rest_blocks);
+  print_counter(F("index_blocks "), p.index_blocks);
+  print_counter(F("circles "), p.circles);
+  print_counter(F("markers "), p.markers);
+  print_counter(F("dot_erases "), p.dot_erases);
+  print_counter(F("list_hits "), p.list_hits);
+  print_counter(F("list_misses "), p.list_misses);
+  print_counter(F("pages "), p.pages);
+  print_counter(F("rects "), p.rects);
+  print_counter(F("chars "), p.chars);
+  print_counter(F("scratch_peak "), scratch_peak());
+}
+
+static void run_command(const char *cmd) {
+  if (strcmp(cmd, "stats") == 0) {
+    print_counters(NULL, NULL, NULL);
+  }
+  else if (strcmp(cmd, "snap") == 0) {
+    snap_perf = perf;
+    snap_image = lcd_image_stats;
+    snap_read = sdread_stats;
+  }
+  else if (strcmp(cmd, "diff") == 0) {
+    print_counters(&snap_perf, &snap_image, &snap_read);
+  }
+  else if (strcmp(cmd, "reset") == 0) {
+    memset(&perf, 0, sizeof(perf));
+    memset(&lcd_image_stats, 0, sizeof(lcd_image_stats));
+    memset(&snap_perf, 0, sizeof(snap_perf));
+    memset(&snap_image, 0, sizeof(snap_image));
+    memset(&sdread_stats, 0, sizeof(sdread_stats));
+    memset(&snap_read, 0, sizeof(snap_read));
+    scratch_reset_peak();
+  }
+  else if (strcmp(cmd, "help") == 0) {
+    Serial.println(F("stats snap diff reset help"));
+    return;
+  }
+  else if (extra_command != NULL && extra_command(cmd)) {
+    return;
+  }
+  else {
+    Serial.print(F("? "));
+    Serial.println(cmd);
+    return;
+  }
+  Serial.println(F("ok"));
+}
+
+void perf_set_command(bool (*command)(const char *line)) {
+  extra_command = command;
+}
+
+void perf_poll() {
+  while (Serial.available() > 0) {
+    char c = Serial.read();
+    if (c == '\r' || c == '\n') {
+      if (line_overflow) {
+        Serial.println(F("? line too long"));
+      }
+      else if (line_len > 0) {
+        line[line_len] = '\0';
+        run_command(line);
+      }
+      line_len = 0;
+      line_overflow = false;
+    }
+    else if (line_len < PERF_LINE_MAX) {
+      line[line_len++] = c;
+    }
+    else {
+      line_overflow = true;
+    }
+  }
+}
@@ -0,0 +1,60 @@
+/*
+ * Always-on counters of the work done by the sketch, and a line-based
+ * Serial console for reading them from a running unit.
+ */
+
+#ifndef _PERF_H
+#define _PERF_H
+
+#include "lcd_image.h"
+
+/* Running totals of restaurant reads and drawing outside lcd_image_draw().
+ *
+ * rest_reads   : calls to getRestaurant()
+ * rest_blocks  : restaurant blocks read from the card
+ * index_blocks : blocks of the name index read by searches
+ * circles      : fillCircle() calls
+ * markers      : cluster markers drawn over the map
+ * dot_erases   : map patches drawn back over dots and markers
+ * list_hits    : nearest lists ready before the joystick was pressed
+ * list_misses  : nearest lists that had to be ranked after the press
+ * pages        : pages of the map drawn whole
+ * rects        : fillRect() calls
+ * chars        : characters of text drawn
+ */
+typedef struct {
+  uint32_t rest_reads;
+  uint32_t rest_blocks;
+  uint32_t index_blocks;
+  uint32_t circles;
+  uint32_t markers;
+  uint32_t dot_erases;
+  uint32_t list_hits;
+  uint32_t list_misses;
+  uint32_t pages;
+  uint32_t rects;
+  uint32_t chars;
+} perf_counters_t;
+
+extern perf_counters_t perf;
+
+/* Reads whatever Serial input has arrived and runs each complete line as
+ * a console command.  Never waits, so it can be called from every pass of
+ * the main loop.  Commands:
+ *
+ * stats : print the totals since power on or the last reset, with those
+ *         of lcd_image.h and sdread.h, and the most of the scratch arena
+ *         (scratch.h) in use at once
+ * snap  : remember the current totals
+ * diff  : print the change in the totals since the last snap
+ * reset : zero the totals and the snapshot, and the scratch peak
+ * help  : list the commands
+ */
+void perf_poll();
+
+/* Passes the console lines that are not one of its own commands to
+ * command, which returns false if it does not know them either.
+ */
+void perf_set_command(bool (*command)(const char *line));
+
+#endif
@@ -0,0 +1,292 @@
+/*
+ * The restaurant data, the map projection and nearest restaurant ranking,
+ * shared by the sketch and the host tools.  Header only, and builds with
+ * avr-gcc as well as host compilers.
+ *
+ * Outside the sketch it also has RestIndex, which keeps the positions of
+ * any number of restaurants as separate arrays of x, y and rating so a
+ * scan streams through them, and ranks with an AVX2 kernel on CPUs that
+ * have it.
+ */
+
+#ifndef _RESTFIND_H
+#define _RESTFIND_H
+
+#include <stdint.h>
+#include "distance.h"
+
+// the full size map, and the latitudes and longitudes of its edges in
+// hundred-thousandths of a degree
+#define MAP_WIDTH 2048
+#define MAP_HEIGHT 2048
+#define LAT_NORTH 5361858l
+#define LAT_SOUTH 5340953l
+#define LON_WEST -11368652l
+#define LON_EAST -11333496l
+
+static_assert(DIST_MAP_SIZE == MAP_WIDTH && DIST_MAP_SIZE == MAP_HEIGHT,
+              "distance.h has another map size");
+static_assert(DIST_LAT_SPAN == LAT_NORTH - LAT_SOUTH
+              && DIST_LON_SPAN == LON_EAST - LON_WEST,
+              "distance.h has other map edges");
+
+/* One restaurant as stored on the SD card, 8 to a 512 byte block.
+ */
+struct Restaurant {
+  int32_t lat; // Stored in 1/100,000 degrees
+  int32_t lon; // Stored in 1/100,000 degrees
+  uint8_t rating; // from 0 to 10
+  char name[55]; // alread null terminated in SD card
+};
+
+/* Map position and rating of a restaurant, all that ranking needs.
+ */
+struct RestPos {
+  int16_t x; // position on the full size map
+  int16_t y;
+  uint8_t rating; // from 0 to 10
+};
+
+/* A restaurant and its distance from a point under a policy from
+ * distance.h.  The sketch's 1066 restaurants fit a 16 bit index; the
+ * host can have more.
+ */
+template <class Metric, class Index = uint16_t>
+struct RankedRest {
+  Index index; // which restaurant
+  typename Metric::dist_t dist; // distance to the point
+};
+
+/* Arduino's map(), always in 32 bit arithmetic so positions come out the
+ * same on the host as on the AVR.
+ */
+static inline int32_t rest_map(int32_t x, int32_t in_min, int32_t in_max,
+                               int32_t out_min, int32_t out_max) {
+  return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+// These functions convert between x/y map position and lat/lon
+static inline int32_t x_to_lon(int16_t x) {
+  return rest_map(x, 0, MAP_WIDTH, LON_WEST, LON_EAST);
+}
+
+static inline int32_t y_to_lat(int16_t y) {
+  return rest_map(y, 0, MAP_HEIGHT, LAT_NORTH, LAT_SOUTH);
+}
+
+static inline int16_t lon_to_x(int32_t lon) {
+  return rest_map(lon, LON_WEST, LON_EAST, 0, MAP_WIDTH);
+}
+
+static inline int16_t lat_to_y(int32_t lat) {
+  return rest_map(lat, LAT_NORTH, LAT_SOUTH, 0, MAP_HEIGHT);
+}
+
+/* Adds a restaurant to a list of the k nearest found so far, nearest
+ * first, if it is nearer than the last of a full list.  A restaurant as
+ * far as one already listed goes after it, so ties keep the order they
+ * were offered in.
+ *
+ * top   : the list, room for k
+ * count : restaurants in the list, updated
+ */
+template <class Metric, class Index>
+static inline void rest_rank_insert(RankedRest<Metric, Index> *top, int &count,
+                                    int k, uint32_t index,
+                                    typename Metric::dist_t dist) {
+  if (count == k) {
+    if (k == 0 || dist >= top[k-1].dist) {
+      return;
+    }
+  }
+  else {
+    count++;
+  }
+  // shift the farther ones down, the last falling off a full list
+  int j = count - 1;
+  for (; j > 0 && top[j-1].dist > dist; j--) {
+    top[j] = top[j-1];
+  }
+  top[j].index = index;
+  top[j].dist = dist;
+}
+
+/* Ranks n restaurants rated at least min_rating by their distance from
+ * (x, y) under Metric, keeping the k nearest in top, nearest first.
+ *
+ * get_pos : called as get_pos(i, &pos) to fetch restaurant i, from
+ *           wherever the caller keeps them
+ *
+ * Returns the number of restaurants in top.
+ */
+template <class Metric, class Index, class GetPos>
+int rest_rank_nearest(GetPos get_pos, int n, int16_t x, int16_t y,
+                      uint8_t min_rating, RankedRest<Metric, Index> *top,
+                      int k) {
+  int count = 0;
+  RestPos pos;
+  for (int i = 0; i < n; i++) {
+    get_pos(i, &pos);
+    if (pos.rating >= min_rating) {
+      rest_rank_insert<Metric>(top, count, k, i,
+                               Metric::dist(pos.x, pos.y, x, y));
+    }
+  }
+  return count;
+}
+
+#ifndef ARDUINO
+
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define REST_HAVE_AVX2_KERNEL 1
+#endif
+
+// restaurants ranked by RestIndex a block at a time, the distances of a
+// block computed together before any are looked at
+#define REST_KERNEL_BLOCK 256
+
+/* Manhattan distances of n restaurants from (x, y), one at a time.
+ */
+static inline void rest_manhattan_scalar(const int16_t *xs, const int16_t *ys,
+                                         int n, int16_t x, int16_t y,
+                                         uint32_t *out) {
+  for (int i = 0; i < n; i++) {
+    out[i] = ManhattanDistance::dist(xs[i], ys[i], x, y);
+  }
+}
+
+#ifdef REST_HAVE_AVX2_KERNEL
+/* Manhattan distances of n restaurants from (x, y), eight at a time in
+ * 32 bit lanes, saturating at 65535 exactly as ManhattanDistance does.
+ * Only to be called when the CPU has AVX2.
+ */
+__attribute__((target("avx2")))
+static inline void rest_manhattan_avx2(const int16_t *xs, const int16_t *ys,
+                                       int n, int16_t x, int16_t y,
+                                       uint32_t *out) {
+  const __m256i px = _mm256_set1_epi32(x);
+  const __m256i py = _mm256_set1_epi32(y);
+  const __m256i limit = _mm256_set1_epi32(0xFFFF);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i vx = _mm256_cvtepi16_epi32(
+        _mm_loadu_si128((const __m128i *) (xs + i)));
+    __m256i vy = _mm256_cvtepi16_epi32(
+        _mm_loadu_si128((const __m128i *) (ys + i)));
+    __m256i d = _mm256_add_epi32(_mm256_abs_epi32(_mm256_sub_epi32(vx, px)),
+                                 _mm256_abs_epi32(_mm256_sub_epi32(vy, py)));
+    _mm256_storeu_si256((__m256i *) (out + i), _mm256_min_epi32(d, limit));
+  }
+  rest_manhattan_scalar(xs + i, ys + i, n - i, x, y, out + i);
+}
+#endif
+
+/* True if this CPU can run the AVX2 kernel.
+ */
+static inline bool rest_have_avx2() {
+#ifdef REST_HAVE_AVX2_KERNEL
+  return __builtin_cpu_supports("avx2");
+#else
+  return false;
+#endif
+}
+
+/* Positions and ratings of any number of restaurants, as structure of
+ * arrays.  Built once and then only read, so one index can be shared by
+ * several threads ranking at once.
+ */
+class RestIndex {
+ public:
+  RestIndex() : simd_(rest_have_avx2()) {}
+
+  void add(const RestPos &pos) {
+    xs_.push_back(pos.x);
+    ys_.push_back(pos.y);
+    ratings_.push_back(pos.rating);
+  }
+
+  size_t size() const { return xs_.size(); }
+
+  void get_pos(int i, RestPos *pos) const {
+    pos->x = xs_[i];
+    pos->y = ys_[i];
+    pos->rating = ratings_[i];
+  }
+
+  /* Ranks with the AVX2 kernel when on is true and the CPU has it, and
+   * with the scalar one otherwise.  Both give the same answers.
+   */
+  void use_simd(bool on) { simd_ = on && rest_have_avx2(); }
+  bool simd() const { return simd_; }
+
+  /* As rest_rank_nearest(), over every restaurant in the index.
+   */
+  template <class Metric>
+  int nearest(int16_t x, int16_t y, uint8_t min_rating,
+              RankedRest<Metric, uint32_t> *top, int k) const {
+    return scan(Metric(), x, y, min_rating, top, k);
+  }
+
+ private:
+  template <class Metric>
+  int scan(Metric, int16_t x, int16_t y, uint8_t min_rating,
+           RankedRest<Metric, uint32_t> *top, int k) const {
+    int count = 0;
+    for (size_t i = 0; i < xs_.size(); i++) {
+      if (ratings_[i] >= min_rating) {
+        rest_rank_insert<Metric>(top, count, k, i,
+                                 Metric::dist(xs_[i], ys_[i], x, y));
+      }
+    }
+    return count;
+  }
+
+  int scan(ManhattanDistance, int16_t x, int16_t y, uint8_t min_rating,
+           RankedRest<ManhattanDistance, uint32_t> *top, int k) const;
+
+  std::vector<int16_t> xs_, ys_;
+  std::vector<uint8_t> ratings_;
+  bool simd_;
+};
+
+/* Manhattan ranking goes through the distance kernels a block at a time.
+ * The list only changes for the few restaurants nearer than its last, so
+ * after the first blocks the scan is almost all kernel.
+ */
+inline int RestIndex::scan(ManhattanDistance, int16_t x, int16_t y,
+                           uint8_t min_rating,
+                           RankedRest<ManhattanDistance, uint32_t> *top,
+                           int k) const {
+  uint32_t dist[REST_KERNEL_BLOCK];
+  int count = 0;
+  int n = xs_.size();
+  if (k == 0) {
+    return 0;
+  }
+  for (int start = 0; start < n; start += REST_KERNEL_BLOCK) {
+    int len = n - start < REST_KERNEL_BLOCK ? n - start : REST_KERNEL_BLOCK;
+#ifdef REST_HAVE_AVX2_KERNEL
+    if (simd_) {
+      rest_manhattan_avx2(&xs_[start], &ys_[start], len, x, y, dist);
+    }
+    else
+#endif
+    rest_manhattan_scalar(&xs_[start], &ys_[start], len, x, y, dist);
+
+    uint32_t worst = count == k ? top[k-1].dist : 0xFFFFFFFFul;
+    for (int i = 0; i < len; i++) {
+      if (dist[i] < worst && ratings_[start + i] >= min_rating) {
+        rest_rank_insert<ManhattanDistance>(top, count, k, start + i, dist[i]);
+        worst = count == k ? top[k-1].dist : 0xFFFFFFFFul;
+      }
+    }
+  }
+  return count;
+}
+
+#endif // ARDUINO
+
+#endif
@@ -0,0 +1,46 @@
+/*
+ * A fixed scratch arena for the temporary buffers of drawing, listing
+ * and ranking.
+ */
+
+#include <Arduino.h>
+
+#include "scratch.h"
+
+static uint8_t arena[SCRATCH_SIZE] __attribute__((aligned(SCRATCH_ALIGN)));
+static uint16_t used = 0;
+static uint16_t peak = 0;
+
+void *scratch_alloc(uint16_t size) {
+  size = SCRATCH_ROUND(size);
+  if (size > SCRATCH_SIZE - used) {
+    Serial.print(F("Scratch arena full, "));
+    Serial.print(size);
+    Serial.print(F(" bytes wanted with "));
+    Serial.print(used);
+    Serial.println(F(" in use"));
+    while (true) {}
+  }
+  void *buf = arena + used;
+  used += size;
+  if (used > peak) {
+    peak = used;
+  }
+  return buf;
+}
+
+void scratch_release(uint16_t mark) {
+  used = mark;
+}
+
+uint16_t scratch_used() {
+  return used;
+}
+
+uint16_t scratch_peak() {
+  return peak;
+}
+
+void scratch_reset_peak() {
+  peak = used;
+}
@@ -0,0 +1,67 @@
+/*
+ * A fixed scratch arena for the temporary buffers of drawing, listing
+ * and ranking, in place of arrays on the stack.  Buffers are checked out
+ * in nested scopes and handed back in reverse order, so the arena works
+ * as a second stack whose size is fixed at compile time and whose
+ * deepest use is tracked.
+ */
+
+#ifndef _SCRATCH_H
+#define _SCRATCH_H
+
+#include <stdint.h>
+
+// bytes in the arena, the deepest any caller goes: reDrawDots() reading
+// a map tile while its DotLayer is checked out (see main.cpp)
+#define SCRATCH_SIZE 936
+
+// buffers start on multiples of this, enough for any type kept in them
+#define SCRATCH_ALIGN sizeof(void *)
+
+// bytes a buffer of the given size takes from the arena
+#define SCRATCH_ROUND(bytes) \
+  (((bytes) + SCRATCH_ALIGN - 1) & ~(SCRATCH_ALIGN - 1))
+
+/* Fails to compile unless bytes, the most a caller ever has checked out
+ * at once, fit in the arena.
+ */
+#define SCRATCH_ASSERT_FITS(bytes) \
+  static_assert((bytes) <= SCRATCH_SIZE, "scratch arena too small")
+
+/* Checks out size bytes.  Running out means a caller's budget check is
+ * wrong, so the sketch reports it over Serial and halts.
+ */
+void *scratch_alloc(uint16_t size);
+
+/* Hands back everything checked out since scratch_used() returned mark.
+ */
+void scratch_release(uint16_t mark);
+
+/* Bytes checked out now, and the most ever checked out at once since
+ * power on or scratch_reset_peak().
+ */
+uint16_t scratch_used();
+uint16_t scratch_peak();
+
+/* Starts measuring the peak again from the current use.
+ */
+void scratch_reset_peak();
+
+/* Checks buffers out for the rest of a block, handing them all back when
+ * it ends, early returns included.
+ */
+class ScratchScope {
+ public:
+  ScratchScope() : mark_(scratch_used()) {}
+  ~ScratchScope() { scratch_release(mark_); }
+
+  template <class T>
+  T *alloc(uint16_t count = 1) {
+    return (T *) scratch_alloc(count * sizeof(T));
+  }
+
+ private:
+  uint16_t mark_;
+};
+
+#endif
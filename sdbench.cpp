@@ -0,0 +1,159 @@
+/*
+ * A benchmark of the ways the sketch can read the SD card, run at power
+ * on when asked for.
+ */
+
+#include <Arduino.h>
+#include <SD.h>
+
+#include "sdbench.h"
+#include "scratch.h"
+
+#define SD_BLOCK_SIZE 512
+
+SCRATCH_ASSERT_FITS(SDBENCH_MAX_READ + SDBENCH_READS * sizeof(uint16_t));
+
+// state of the generator of random offsets
+static uint32_t seed;
+
+static uint32_t next_random(uint32_t range) {
+  seed = seed * 1103515245UL + 12345;
+  return (seed >> 8) % range;
+}
+
+static const char *const spi_names[] = {"full", "half", "quarter"};
+
+/* Sorts the read times and prints the line of one test.
+ */
+static void report(const char *test, uint16_t size, uint16_t align,
+                   uint8_t spi, uint16_t *times, uint32_t total_us)
+{
+  for (uint16_t i = 1; i < SDBENCH_READS; i++) {
+    uint16_t t = times[i];
+    uint16_t j = i;
+    for (; j > 0 && times[j - 1] > t; j--) {
+      times[j] = times[j - 1];
+    }
+    times[j] = t;
+  }
+
+  // KB a second, scaled before dividing so short tests keep their digits
+  uint32_t bytes = (uint32_t) size * SDBENCH_READS;
+  uint32_t kbps = (uint64_t) bytes * 1000000 / 1024 / max(total_us, 1UL);
+
+  Serial.print(F("sdbench "));
+  Serial.print(test);
+  Serial.print(' ');
+  Serial.print(size);
+  Serial.print(' ');
+  Serial.print(align);
+  Serial.print(' ');
+  Serial.print(spi_names[spi]);
+  Serial.print(' ');
+  Serial.print(kbps);
+  Serial.print(' ');
+  Serial.print(times[SDBENCH_READS / 2]);
+  Serial.print(' ');
+  Serial.print(times[SDBENCH_READS * 9 / 10]);
+  Serial.print(' ');
+  Serial.println(times[SDBENCH_READS * 99 / 100]);
+}
+
+/* Times the reads of one test, returning the total in us and filling in
+ * times with each read, saturating at 65535.  A failed read ends the
+ * test early and returns 0.
+ */
+static uint32_t time_reads(Sd2Card *card, File *file, bool random,
+                           uint16_t size, uint16_t align,
+                           uint32_t first_block, uint32_t blocks,
+                           uint8_t *buf, uint16_t *times)
+{
+  uint32_t slots = file != NULL ? (file->size() - align) / size : blocks;
+  uint32_t total = 0;
+  seed = 1;
+  for (uint16_t i = 0; i < SDBENCH_READS; i++) {
+    uint32_t slot = random ? next_random(slots) : i % slots;
+    uint32_t start = micros();
+    bool ok;
+    if (file != NULL) {
+      ok = file->seek(slot * size + align) && file->read(buf, size) == size;
+    } else {
+      ok = card->readBlock(first_block + slot, buf);
+    }
+    uint32_t elapsed = micros() - start;
+    if (!ok) {
+      return 0;
+    }
+    times[i] = min(elapsed, 65535UL);
+    total += elapsed;
+  }
+  return total;
+}
+
+/* Runs one test and prints its line, or why it could not be run.
+ */
+static void run_test(Sd2Card *card, File *file, bool random,
+                     uint16_t size, uint16_t align, uint8_t spi,
+                     uint32_t first_block, uint32_t blocks)
+{
+  const char *test = file != NULL ? (random ? "file-rand" : "file-seq")
+                                  : (random ? "raw-rand" : "raw-seq");
+  ScratchScope scope;
+  uint8_t *buf = scope.alloc<uint8_t>(SDBENCH_MAX_READ);
+  uint16_t *times = scope.alloc<uint16_t>(SDBENCH_READS);
+
+  uint32_t total = time_reads(card, file, random, size, align,
+                              first_block, blocks, buf, times);
+  if (total == 0) {
+    Serial.print(F("sdbench "));
+    Serial.print(test);
+    Serial.println(F(" read failed"));
+    return;
+  }
+  report(test, size, align, spi, times, total);
+}
+
+void sdbench_run(Sd2Card *card, uint8_t cs_pin, const char *file_name,
+                 uint32_t first_block, uint32_t blocks)
+{
+  static const uint16_t sizes[] = {16, 64, 128, 256, 512};
+  static const uint16_t aligns[] = {2, 256};
+
+  File file = SD.open(file_name);
+  if (!file) {
+    Serial.print(F("sdbench cannot open "));
+    Serial.println(file_name);
+    return;
+  }
+  Serial.print(F("sdbench "));
+  Serial.print(file_name);
+  Serial.print(F(", "));
+  Serial.print(SDBENCH_READS);
+  Serial.println(F(" reads a test"));
+  Serial.println(F("sdbench test size align spi KB/s p50_us p90_us p99_us"));
+
+  // every kind of read at each clock, the fastest first
+  for (uint8_t spi = SPI_FULL_SPEED; spi <= SPI_QUARTER_SPEED; spi++) {
+    if (!card->init(spi, cs_pin)) {
+      Serial.print(F("sdbench no card at "));
+      Serial.println(spi_names[spi]);
+      continue;
+    }
+    for (uint8_t random = 0; random < 2; random++) {
+      run_test(card, NULL, random, SD_BLOCK_SIZE, 0, spi, first_block, blocks);
+      run_test(card, &file, random, SD_BLOCK_SIZE, 0, spi, 0, 0);
+    }
+  }
+
+  // sizes and alignments at the clock the sketch runs with
+  card->init(SPI_HALF_SPEED, cs_pin);
+  for (uint8_t random = 0; random < 2; random++) {
+    for (uint8_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+      run_test(card, &file, random, sizes[i], 0, SPI_HALF_SPEED, 0, 0);
+    }
+    for (uint8_t i = 0; i < sizeof(aligns) / sizeof(aligns[0]); i++) {
+      run_test(card, &file, random, SD_BLOCK_SIZE, aligns[i], SPI_HALF_SPEED, 0, 0);
+    }
+  }
+  file.close();
+}
@@ -0,0 +1,41 @@
+/*
+ * A benchmark of the ways the sketch can read the SD card, run at power
+ * on when asked for.  It times reads of the map file through the SD
+ * library and of the restaurant region as raw blocks, and prints the
+ * throughput and read latencies of each over Serial.
+ */
+
+#ifndef _SDBENCH_H
+#define _SDBENCH_H
+
+#include <SD.h>
+
+// reads timed in each test, and the largest read size swept
+#define SDBENCH_READS 100
+#define SDBENCH_MAX_READ 512
+
+/* Runs every test, printing a header and then one line per test:
+ *
+ *   sdbench <test> <size> <align> <spi> <KB/s> <p50> <p90> <p99>
+ *
+ * test  : file-seq or file-rand for File::read() of size bytes at
+ *         offsets align bytes past a multiple of size, in order or at
+ *         random; raw-seq or raw-rand for Sd2Card::readBlock()
+ * spi   : the clock given to card->init(), full, half or quarter
+ * p50.. : percentiles of the time of one read, seek included, in us
+ *
+ * The SPI clock is shared by the raw card and the SD library, so every
+ * kind of read is timed at each setting; sizes and alignments are then
+ * swept at SPI_HALF_SPEED, which the card is left at.  Random offsets
+ * come from a fixed seed, so runs are comparable.
+ *
+ * card        : the raw card, already initialised
+ * cs_pin      : its chip select
+ * file_name   : a file on the card read through the SD library
+ * first_block : the first of the blocks read raw
+ * blocks      : how many there are
+ */
+void sdbench_run(Sd2Card *card, uint8_t cs_pin, const char *file_name,
+                 uint32_t first_block, uint32_t blocks);
+
+#endif
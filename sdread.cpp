@@ -0,0 +1,62 @@
+/*
+ * Reads from the SD card that give up after a fixed number of tries.
+ */
+
+#include <Arduino.h>
+#include <SD.h>
+
+#include "sdread.h"
+
+sdread_stats_t sdread_stats;
+
+/* Waits before retry number try (from 1) of a read and counts it. */
+static void back_off(uint8_t try_number) {
+  sdread_stats.retries++;
+  delayMicroseconds(SDREAD_BACKOFF_US << (try_number - 1));
+}
+
+/* Records how a read that started at start ended. */
+static bool finish(uint32_t start, bool ok) {
+  uint32_t elapsed = micros() - start;
+  if (elapsed > sdread_stats.worst_us) {
+    sdread_stats.worst_us = elapsed;
+  }
+  if (!ok) {
+    sdread_stats.failures++;
+  }
+  return ok;
+}
+
+bool sdread_block(Sd2Card *card, uint32_t block, uint8_t *dst) {
+  uint32_t start = micros();
+  sdread_stats.reads++;
+  for (uint8_t i = 0; i < SDREAD_TRIES; i++) {
+    if (i > 0) {
+      back_off(i);
+    }
+    if (card->readBlock(block, dst)) {
+      return finish(start, true);
+    }
+  }
+  return finish(start, false);
+}
+
+bool sdread_file(File &file, uint32_t pos, bool seek, uint8_t *buf,
+                 uint16_t len)
+{
+  uint32_t start = micros();
+  sdread_stats.reads++;
+  for (uint8_t i = 0; i < SDREAD_TRIES; i++) {
+    if (i > 0) {
+      back_off(i);
+      seek = true;
+    }
+    if (seek && !file.seek(pos)) {
+      continue;
+    }
+    if (file.read(buf, len) == len) {
+      return finish(start, true);
+    }
+  }
+  return finish(start, false);
+}
@@ -0,0 +1,50 @@
+/*
+ * Reads from the SD card that give up after a fixed number of tries, so a
+ * flaky card slows a unit down for a bounded time instead of freezing it.
+ * Callers get false for a read that never succeeded and carry on without
+ * its data: a placeholder is drawn or the item is left out.
+ */
+
+#ifndef _SDREAD_H
+#define _SDREAD_H
+
+#include <SD.h>
+
+// attempts at one read before it is given up
+#define SDREAD_TRIES 3
+
+// wait before the first retry of a read, doubled before each one after
+#define SDREAD_BACKOFF_US 250
+
+/* Running totals of the reads made through this layer.
+ *
+ * reads    : reads asked for
+ * retries  : failed attempts that were tried again
+ * failures : reads given up after SDREAD_TRIES attempts
+ * worst_us : the longest any read took, retries and waits included
+ */
+typedef struct {
+  uint32_t reads;
+  uint32_t retries;
+  uint32_t failures;
+  uint32_t worst_us;
+} sdread_stats_t;
+
+extern sdread_stats_t sdread_stats;
+
+/* Reads one raw block of the card into the 512 bytes at dst.
+ *
+ * Returns true if the block was read; otherwise dst holds nothing useful.
+ */
+bool sdread_block(Sd2Card *card, uint32_t block, uint8_t *dst);
+
+/* Reads len bytes at offset pos of file into buf.  seek says whether the
+ * file must be moved to pos first; retries always seek, since a failed
+ * read leaves the position unknown.
+ *
+ * Returns true if all len bytes were read.
+ */
+bool sdread_file(File &file, uint32_t pos, bool seek, uint8_t *buf,
+                 uint16_t len);
+
+#endif
@@ -0,0 +1,48 @@
+/*
+ * Host stand-in for the Adafruit GFX primitives used by the sketch.  All
+ * drawing lands in the simulator's frame buffer, see sim.cpp.
+ */
+
+#ifndef _SIM_ADAFRUIT_GFX_H
+#define _SIM_ADAFRUIT_GFX_H
+
+#include <Arduino.h>
+
+class Adafruit_GFX : public Print {
+ public:
+  Adafruit_GFX();
+
+  void startWrite();
+  void endWrite();
+
+  void drawPixel(int16_t x, int16_t y, uint16_t colour);
+  void drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t colour);
+  void drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t colour);
+  void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t colour);
+  void drawRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t colour);
+  void fillScreen(uint16_t colour);
+  void fillCircle(int16_t x0, int16_t y0, int16_t r, uint16_t colour);
+  void drawCircle(int16_t x0, int16_t y0, int16_t r, uint16_t colour);
+
+  void setCursor(int16_t x, int16_t y);
+  void setTextColor(uint16_t c);
+  void setTextColor(uint16_t c, uint16_t bg);
+  void setTextSize(uint8_t s);
+  void setTextWrap(bool w);
+  void setRotation(uint8_t r);
+  int16_t getCursorX() const { return cursor_x; }
+  int16_t getCursorY() const { return cursor_y; }
+  int16_t width() const;
+  int16_t height() const;
+
+  size_t write(uint8_t c);
+  using Print::write;
+
+ protected:
+  int16_t cursor_x, cursor_y;
+  uint16_t textcolor, textbgcolor;
+  uint8_t textsize;
+  bool wrap;
+};
+
+#endif
@@ -0,0 +1,97 @@
+/*
+ * Host stand-in for the parts of the Arduino core used by the sketch.
+ * Inputs come from the replayed trace and time is the simulator's
+ * modelled clock, see sim.cpp.
+ */
+
+#ifndef _SIM_ARDUINO_H
+#define _SIM_ARDUINO_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <math.h>
+
+#include <avr/pgmspace.h>
+
+// as the Arduino build defines it, for code shared with host tools
+#ifndef ARDUINO
+#define ARDUINO 100
+#endif
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+// Mega2560 analog pin numbers
+#define A0 54
+#define A1 55
+#define A2 56
+#define A3 57
+#define A4 58
+#define A5 59
+#define A6 60
+#define A7 61
+#define A8 62
+#define A9 63
+
+#define min(a,b) ((a)<(b)?(a):(b))
+#define max(a,b) ((a)>(b)?(a):(b))
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+long map(long x, long in_min, long in_max, long out_min, long out_max);
+
+void init();
+int analogRead(uint8_t pin);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t val);
+void pinMode(uint8_t pin, uint8_t mode);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+unsigned long millis();
+unsigned long micros();
+
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+
+  size_t print(const __FlashStringHelper *s);
+  size_t print(const char *s);
+  size_t print(char c);
+  size_t print(int n, int base = 10);
+  size_t print(unsigned int n, int base = 10);
+  size_t print(long n, int base = 10);
+  size_t print(unsigned long n, int base = 10);
+  size_t print(double n, int digits = 2);
+
+  size_t println();
+  size_t println(const __FlashStringHelper *s);
+  size_t println(const char *s);
+  size_t println(char c);
+  size_t println(int n, int base = 10);
+  size_t println(unsigned int n, int base = 10);
+  size_t println(long n, int base = 10);
+  size_t println(unsigned long n, int base = 10);
+  size_t println(double n, int digits = 2);
+};
+
+class HardwareSerial : public Print {
+ public:
+  void begin(unsigned long baud);
+  void end();
+  int available();
+  int read();
+  size_t write(uint8_t c);
+  using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+#endif
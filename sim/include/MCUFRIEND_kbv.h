@@ -0,0 +1,33 @@
+/*
+ * Host stand-in for the MCUFRIEND_kbv display driver, see sim.cpp.
+ */
+
+#ifndef _SIM_MCUFRIEND_KBV_H
+#define _SIM_MCUFRIEND_KBV_H
+
+#include <Adafruit_GFX.h>
+
+#define TFT_BLACK       0x0000
+#define TFT_NAVY        0x000F
+#define TFT_DARKGREEN   0x03E0
+#define TFT_MAROON      0x7800
+#define TFT_LIGHTGREY   0xC618
+#define TFT_DARKGREY    0x7BEF
+#define TFT_BLUE        0x001F
+#define TFT_GREEN       0x07E0
+#define TFT_CYAN        0x07FF
+#define TFT_RED         0xF800
+#define TFT_MAGENTA     0xF81F
+#define TFT_YELLOW      0xFFE0
+#define TFT_WHITE       0xFFFF
+#define TFT_ORANGE      0xFDA0
+
+class MCUFRIEND_kbv : public Adafruit_GFX {
+ public:
+  uint16_t readID();
+  void begin(uint16_t id);
+  void setAddrWindow(int16_t x, int16_t y, int16_t x1, int16_t y1);
+  void pushColors(uint16_t *block, int16_t n, bool first);
+};
+
+#endif
@@ -0,0 +1,48 @@
+/*
+ * Host stand-in for the SD library.  Files are read from the simulated
+ * card directory and raw blocks from its block image, see sim.cpp.
+ */
+
+#ifndef _SIM_SD_H
+#define _SIM_SD_H
+
+#include <Arduino.h>
+
+#define SPI_FULL_SPEED 0
+#define SPI_HALF_SPEED 1
+#define SPI_QUARTER_SPEED 2
+
+#define FILE_READ 1
+
+class File {
+ public:
+  File();
+  int read(void *buf, uint16_t nbyte);
+  int read();
+  int available();
+  bool seek(uint32_t pos);
+  uint32_t position();
+  uint32_t size();
+  void close();
+  operator bool() const;
+
+  int handle;  // index into the simulator's open files, -1 if none
+};
+
+class SDClass {
+ public:
+  bool begin(uint8_t csPin);
+  File open(const char *path, uint8_t mode = FILE_READ);
+  bool exists(const char *path);
+};
+
+extern SDClass SD;
+
+class Sd2Card {
+ public:
+  bool init(uint8_t sckRateID, uint8_t chipSelectPin);
+  bool readBlock(uint32_t block, uint8_t *dst);
+  uint8_t errorCode() const { return 0; }
+};
+
+#endif
@@ -0,0 +1,3 @@
+/*
+ * Host stand-in for SPI.h, nothing is needed from it.
+ */
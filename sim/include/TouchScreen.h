@@ -0,0 +1,22 @@
+/*
+ * Host stand-in for the TouchScreen library, points come from the trace.
+ */
+
+#ifndef _SIM_TOUCHSCREEN_H
+#define _SIM_TOUCHSCREEN_H
+
+#include <Arduino.h>
+
+class TSPoint {
+ public:
+  TSPoint() : x(0), y(0), z(0) {}
+  int16_t x, y, z;
+};
+
+class TouchScreen {
+ public:
+  TouchScreen(uint8_t xp, uint8_t yp, uint8_t xm, uint8_t ym, uint16_t rx);
+  TSPoint getPoint();
+};
+
+#endif
@@ -0,0 +1,23 @@
+/*
+ * Host stand-in for avr/pgmspace.h: flash and RAM are the same memory.
+ */
+
+#ifndef _SIM_PGMSPACE_H
+#define _SIM_PGMSPACE_H
+
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+// F() strings keep their own type so Print can tell them apart, as on AVR
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(s))
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
+#define pgm_read_dword(p) (*(const uint32_t *)(p))
+#define memcpy_P memcpy
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strlen_P strlen
+
+#endif
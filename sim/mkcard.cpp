@@ -0,0 +1,162 @@
+/*
+ * Writes a synthetic SD card for the simulator when the real data is not
+ * at hand: yeg-big.lcd, a 2048x2048 map made of flat areas (land, a
+ * river, parks and a grid of roads), and restaurants.bin, the raw blocks
+ * that start at REST_START_BLOCK, holding NUM_RESTAURANTS restaurants
+ * clustered around a downtown.  Everything comes from a fixed seed so
+ * benchmark baselines are reproducible.  Existing files are left alone,
+ * so copying the real yeg-big.lcd and a dump of the restaurant blocks into
+ * the card directory makes the simulator use them instead.
+ *
+ * Usage: mkcard <card dir>
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// must match main.cpp
+#define MAP_WIDTH 2048
+#define MAP_HEIGHT 2048
+#define LAT_NORTH 5361858l
+#define LAT_SOUTH 5340953l
+#define LON_WEST -11368652l
+#define LON_EAST -11333496l
+#define NUM_RESTAURANTS 1066
+
+struct Restaurant {
+  int32_t lat;
+  int32_t lon;
+  uint8_t rating;
+  char name[55];
+};
+
+static uint32_t seed = 275;
+
+static uint32_t rnd() {
+  seed = seed * 1103515245u + 12345u;
+  return (seed >> 8) & 0xFFFFFF;
+}
+
+static double uniform() {
+  return rnd() / (double) 0x1000000;
+}
+
+static double gaussian() {
+  double u = max(uniform(), 1e-9), v = uniform();
+  return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+static bool exists(const string &path) {
+  return ifstream(path.c_str()).good();
+}
+
+// RGB565, stored on the card most significant byte first
+static uint16_t stored(uint16_t rgb) {
+  return (rgb << 8) | (rgb >> 8);
+}
+
+static void writeMap(const string &path) {
+  const uint16_t land = 0xEF5B, water = 0x9DFF, park = 0xAF50,
+    road = 0xFFFF, highway = 0xFEA0;
+
+  vector<uint16_t> pixels((size_t) MAP_WIDTH * MAP_HEIGHT, land);
+
+  // parks
+  for (int i = 0; i < 60; i++) {
+    int x0 = rnd() % MAP_WIDTH, y0 = rnd() % MAP_HEIGHT;
+    int w = 20 + rnd() % 120, h = 20 + rnd() % 120;
+    for (int y = y0; y < min(y0 + h, MAP_HEIGHT); y++) {
+      for (int x = x0; x < min(x0 + w, MAP_WIDTH); x++) {
+        pixels[(size_t) y * MAP_WIDTH + x] = park;
+      }
+    }
+  }
+
+  for (int y = 0; y < MAP_HEIGHT; y++) {
+    // a river winding across the map from west to east
+    for (int x = 0; x < MAP_WIDTH; x++) {
+      double centre = 1000 + 250 * sin(x / 280.0) + 60 * sin(x / 67.0);
+      uint16_t &p = pixels[(size_t) y * MAP_WIDTH + x];
+      if (fabs(y - centre) < 22) {
+        p = water;
+      } else if (x % 256 < 6 || y % 256 < 6) {
+        p = highway;
+      } else if (x % 32 < 2 || y % 32 < 2) {
+        p = road;
+      }
+    }
+  }
+
+  for (uint16_t &p : pixels) {
+    p = stored(p);
+  }
+  ofstream out(path.c_str(), ios::binary);
+  out.write((const char *) pixels.data(), pixels.size() * 2);
+  cout << "wrote " << path << endl;
+}
+
+static void writeRestaurants(const string &path) {
+  static const char *first[] = { "Golden", "Happy", "Blue", "Red", "Little",
+    "Royal", "Urban", "Old", "Prairie", "River", "Northern", "Lucky",
+    "Green", "Silver", "Sunny", "Jasper" };
+  static const char *second[] = { "Dragon", "Maple", "Lotus", "Bison",
+    "Garden", "Oven", "Spoon", "Fork", "Pepper", "Noodle", "Taco", "Curry",
+    "Pho", "Burger", "Bagel", "Sushi" };
+  static const char *third[] = { "House", "Cafe", "Bistro", "Grill",
+    "Kitchen", "Diner", "Eatery", "Bar", "Express", "Palace" };
+
+  vector<Restaurant> rests(NUM_RESTAURANTS);
+  for (int i = 0; i < NUM_RESTAURANTS; i++) {
+    double x, y;
+    if (i % 100 == 99) {
+      // a few are off the map altogether
+      x = -200 + uniform() * (MAP_WIDTH + 400);
+      y = uniform() < 0.5 ? -100 : MAP_HEIGHT + 100;
+    } else if (uniform() < 0.6) {
+      x = 1100 + 160 * gaussian();
+      y = 880 + 120 * gaussian();
+    } else {
+      x = uniform() * MAP_WIDTH;
+      y = uniform() * MAP_HEIGHT;
+    }
+
+    Restaurant &r = rests[i];
+    memset(&r, 0, sizeof(r));
+    r.lon = LON_WEST + (int32_t) (x * (LON_EAST - LON_WEST) / MAP_WIDTH);
+    r.lat = LAT_NORTH + (int32_t) (y * (LAT_SOUTH - LAT_NORTH) / MAP_HEIGHT);
+    r.rating = rnd() % 11;
+    snprintf(r.name, sizeof(r.name), "%s %s %s", first[rnd() % 16],
+             second[rnd() % 16], third[rnd() % 10]);
+  }
+
+  // 8 restaurants per block, last block padded
+  vector<uint8_t> blocks((NUM_RESTAURANTS + 7) / 8 * 512, 0);
+  memcpy(blocks.data(), rests.data(), rests.size() * sizeof(Restaurant));
+  ofstream out(path.c_str(), ios::binary);
+  out.write((const char *) blocks.data(), blocks.size());
+  cout << "wrote " << path << endl;
+}
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    cerr << "usage: mkcard <card dir>" << endl;
+    return 1;
+  }
+  static_assert(sizeof(Restaurant) == 64, "8 restaurants per block");
+  string dir = argv[1];
+  if (!exists(dir + "/yeg-big.lcd")) {
+    writeMap(dir + "/yeg-big.lcd");
+  }
+  if (!exists(dir + "/restaurants.bin")) {
+    writeRestaurants(dir + "/restaurants.bin");
+  }
+  return 0;
+}
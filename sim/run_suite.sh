@@ -0,0 +1,48 @@
+#!/bin/sh
+#
+# Replays every trace in traces/ with one simulator build and compares the
+# reported costs against a stored baseline.  Every metric is a cost, so a
+# value more than TOLERANCE percent above its baseline is a regression.
+#
+# Usage: run_suite.sh <simulator> <baseline file>
+#   UPDATE=1 run_suite.sh ...   rewrites the baseline with this run
+#
+# Exits non-zero if any scenario regressed.
+
+SIM=${1:?usage: run_suite.sh <simulator> <baseline file>}
+BASELINE=${2:?usage: run_suite.sh <simulator> <baseline file>}
+TOLERANCE=${TOLERANCE:-2}
+CARD=${SIM_CARD:-card}
+
+results=$(mktemp)
+trap 'rm -f "$results"' EXIT
+
+for trace in traces/*.trace; do
+	scenario=$(basename "$trace" .trace)
+	SIM_TRACE="$trace" SIM_CARD="$CARD" "$SIM" |
+		sed "s/^/$scenario /" >> "$results" || exit 2
+done
+
+if [ -n "$UPDATE" ] || [ ! -f "$BASELINE" ]; then
+	cp "$results" "$BASELINE"
+	echo "$SIM: baseline written to $BASELINE"
+	exit 0
+fi
+
+echo "$SIM against $BASELINE"
+awk -v tol="$TOLERANCE" '
+	NR == FNR { base[$1 " " $2] = $3; next }
+	{
+		key = $1 " " $2
+		flag = ""
+		if (!(key in base)) {
+			flag = "  (new)"
+		} else if ($3 > base[key] * (1 + tol / 100)) {
+			flag = "  REGRESSION"
+			bad = 1
+		}
+		delta = (key in base && base[key] > 0) ? sprintf("%+.1f%%", 100 * ($3 - base[key]) / base[key]) : "-"
+		printf "  %-20s %-12s %12d %8s%s\n", $1, $2, $3, delta, flag
+	}
+	END { exit bad }
+' "$BASELINE" "$results"
@@ -0,0 +1,849 @@
+/*
+ * Host simulator for the restaurant finder.
+ *
+ * Builds the unchanged sketch (../main.cpp, ../hud.cpp, ../lcd_image.cpp,
+ * ../perf.cpp, ../scratch.cpp, ../sdbench.cpp, ../sdread.cpp) against the
+ * stand-in headers in include/, replays a recorded input trace into it and reports
+ * what the run cost: SD traffic, pixels pushed to the display, display
+ * operations, modelled time and peak stack and scratch arena use.  time_ms is the whole run including
+ * waits for input; busy_ms only counts SD, display and Serial work.
+ * overdraw counts pixels written again within one frame, a frame being
+ * the drawing between two delay() calls; each is a pixel push that did
+ * not change what was finally shown.  frame_peak_ms is the busy time of
+ * the longest frame, the worst the sketch kept input waiting.
+ *
+ * Environment:
+ *   SIM_TRACE   trace to replay (required)
+ *   SIM_CARD    directory holding the card's files, default "card"
+ *   SIM_RESTAURANTS
+ *               file in SIM_CARD holding the raw blocks from
+ *               REST_START_BLOCK on, default "restaurants.bin"
+ *   SIM_SCREEN  if set, the final screen is written there as a PPM image
+ *   SIM_VERBOSE if set, the sketch's Serial output is echoed to stderr
+ *   SIM_SD_ERRORS
+ *               fraction of SD block reads that fail, default 0; a failed
+ *               read takes as long as one that succeeds, and the same
+ *               reads fail in every run
+ *
+ * Trace format: one sample per line,
+ *   T <ms> <joy horiz> <joy vert> <joy sel> <touch x> <touch y> <touch z>
+ * holding from <ms> until the next sample; the run ends at the time of the
+ * last sample.  Times count from the sketch's first input read after the
+ * button read at power on, so boot time does not shift the trace.  Lines not starting with "T " are ignored,
+ * so a Serial log from a -DTRACE_RECORD build replays as is.  A touch
+ * sample (z > 0) is a tap, seen by exactly one ts.getPoint(): the first
+ * one made once the tap has started.  A line
+ *   S <ms> <text>
+ * types <text> and a newline into the sketch's Serial input at <ms>.
+ * A first sample with the joystick button down runs the sketch's SD card
+ * benchmark (../sdbench.h) at power on, as on the unit; sdbench.trace
+ * does that, and make sdbench prints its results.
+ *
+ * Time is not measured but modelled: every SD block, display operation,
+ * analog read, delay() and Serial character advances the clock by a fixed
+ * cost (see the COST_ constants).  Computation is not modelled.  The
+ * numbers are for comparing builds against each other, not absolute.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+#include "MCUFRIEND_kbv.h"
+#include "SD.h"
+#include "TouchScreen.h"
+#include "../scratch.h"
+
+using namespace std;
+
+// must match main.cpp
+#define REST_START_BLOCK 4000000
+
+#define SCREEN_WIDTH 480
+#define SCREEN_HEIGHT 320
+#define BLOCK_SIZE 512
+
+// modelled costs in nanoseconds
+#define COST_SD_COMMAND    176000  // command and wait for a block's data
+#define COST_SD_TRANSFER   512000  // a block's data at SPI_FULL_SPEED, 8 MHz
+#define COST_SD_OPEN      3600000  // directory search, about three blocks
+#define COST_SD_SEEK       100000  // cluster chain walk
+#define COST_WINDOW         10000  // setAddrWindow() or any primitive's setup
+#define COST_PIXEL_PUSH      1000  // per pixel sent by pushColors()
+#define COST_PIXEL_FILL       500  // per pixel of a solid fill
+#define COST_ANALOG_READ   112000
+#define COST_DIGITAL_READ    1000
+#define COST_SERIAL_CHAR  1041667  // 9600 baud, 10 bits per character
+#define SERIAL_TX_BUFFER       64
+
+HardwareSerial Serial;
+SDClass SD;
+
+/* Totals reported at the end of a run. */
+static struct {
+  uint64_t sd_bytes;    // bytes delivered by File reads and raw blocks
+  uint64_t sd_blocks;   // blocks read from the card
+  uint64_t sd_seeks;
+  uint64_t sd_opens;
+  uint64_t pixels;      // pixels written to the display
+  uint64_t draw_ops;    // shapes, characters and address windows drawn
+  uint64_t overdraw;    // pixels written more than once in a frame
+  uint64_t frame_peak;  // busy ns of the longest frame
+  uint64_t sd_errors;   // block reads failed by SIM_SD_ERRORS
+  uint64_t stack_peak;  // bytes of stack below init()'s frame
+} stats;
+
+// counts the frames for overdraw, see put_pixel()
+static uint32_t frame_number = 1;
+
+static uint64_t now_ns = 0;
+static uint64_t serial_drain_ns = 0;  // when the Serial buffer will be empty
+static bool verbose = false;
+static const char *screen_path = NULL;
+static char *stack_base = NULL;
+
+static void finish();
+
+// the SPI clock set by the last Sd2Card::init() or SD.begin(), shared by
+// raw and File reads as it is on the unit
+static uint8_t spi_rate = SPI_HALF_SPEED;
+
+// a block read from the card at the current clock, 1.2 ms at half speed
+static uint64_t sd_block_cost() {
+  return COST_SD_COMMAND + ((uint64_t) COST_SD_TRANSFER << spi_rate);
+}
+
+static void advance(uint64_t ns) {
+  now_ns += ns;
+}
+
+// time spent on SD, display and Serial work rather than waiting for input
+static uint64_t busy_ns = 0;
+
+static void work(uint64_t ns) {
+  now_ns += ns;
+  busy_ns += ns;
+}
+
+// busy_ns when the current frame started
+static uint64_t frame_busy_ns = 0;
+
+// fraction of block reads that fail, and the state of the generator
+// picking them
+static double sd_error_rate = 0;
+static uint32_t sd_error_seed = 1;
+
+/* Decides whether the block read being made fails. */
+static bool sd_fault() {
+  if (sd_error_rate <= 0) {
+    return false;
+  }
+  sd_error_seed = sd_error_seed * 1103515245u + 12345;
+  if ((sd_error_seed >> 8) % 1000000 < sd_error_rate * 1000000) {
+    stats.sd_errors++;
+    return true;
+  }
+  return false;
+}
+
+/* Samples the stack depth; called from every stand-in the sketch uses
+ * often enough to catch its deepest frames.
+ */
+static void probe_stack() {
+  char probe;
+  if (stack_base != NULL && stack_base > &probe) {
+    uint64_t depth = stack_base - &probe;
+    if (depth > stats.stack_peak) {
+      stats.stack_peak = depth;
+    }
+  }
+}
+
+// ---------------------------------------------------------------- trace
+
+struct Sample {
+  uint64_t ms;
+  int horiz, vert, sel;
+  int tx, ty, tz;
+  bool tapped;
+};
+
+// a line of Serial input and the trace time it arrives at
+struct SerialLine {
+  uint64_t ms;
+  string text;
+};
+
+static vector<Sample> trace;
+static vector<SerialLine> serial_in;
+static size_t serial_line = 0;  // next line of serial_in to be read
+static size_t serial_char = 0;  // next character of that line
+static bool trace_started = false;
+static uint64_t trace_start_ns = 0;
+
+static void load_trace(const char *path) {
+  ifstream in(path);
+  if (!in) {
+    fprintf(stderr, "sim: cannot open trace %s\n", path);
+    exit(2);
+  }
+  string line;
+  while (getline(in, line)) {
+    Sample s = Sample();
+    unsigned long long ms;
+    if (sscanf(line.c_str(), "T %llu %d %d %d %d %d %d", &ms, &s.horiz,
+               &s.vert, &s.sel, &s.tx, &s.ty, &s.tz) == 7) {
+      s.ms = ms;
+      trace.push_back(s);
+    }
+    int text = 0;
+    if (sscanf(line.c_str(), "S %llu %n", &ms, &text) == 1 && text > 0) {
+      SerialLine l = { ms, line.substr(text) + "\n" };
+      serial_in.push_back(l);
+    }
+  }
+  if (trace.empty()) {
+    fprintf(stderr, "sim: no samples in %s\n", path);
+    exit(2);
+  }
+}
+
+/* Returns the trace time now, ending the run once the trace is over. */
+static uint64_t trace_ms() {
+  probe_stack();
+  if (!trace_started) {
+    trace_started = true;
+    trace_start_ns = now_ns;
+  }
+  uint64_t ms = (now_ns - trace_start_ns) / 1000000;
+  if (ms >= trace.back().ms) {
+    finish();
+  }
+  return ms;
+}
+
+/* Returns the sample in effect now. */
+static Sample &current_sample() {
+  uint64_t ms = trace_ms();
+  size_t i = 0;
+  while (i + 1 < trace.size() && trace[i + 1].ms <= ms) {
+    i++;
+  }
+  return trace[i];
+}
+
+// ---------------------------------------------------------------- core
+
+long map(long x, long in_min, long in_max, long out_min, long out_max) {
+  return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+void init() {
+  char base;
+  stack_base = &base;
+
+  const char *path = getenv("SIM_TRACE");
+  if (path == NULL) {
+    fprintf(stderr, "sim: set SIM_TRACE to the trace to replay\n");
+    exit(2);
+  }
+  load_trace(path);
+  verbose = getenv("SIM_VERBOSE") != NULL;
+  const char *errors = getenv("SIM_SD_ERRORS");
+  if (errors != NULL) {
+    sd_error_rate = atof(errors);
+  }
+  screen_path = getenv("SIM_SCREEN");
+}
+
+int analogRead(uint8_t pin) {
+  advance(COST_ANALOG_READ);
+  Sample &s = current_sample();
+  if (pin == A8) {
+    return s.horiz;
+  }
+  if (pin == A9) {
+    return s.vert;
+  }
+  return 0;
+}
+
+int digitalRead(uint8_t pin) {
+  advance(COST_DIGITAL_READ);
+  // the first read, of the button at power on, sees the first sample
+  // without starting the trace
+  static bool power_on = true;
+  Sample &s = power_on && !trace_started ? trace[0] : current_sample();
+  power_on = false;
+  // the joystick button is the only digital input
+  return s.sel ? HIGH : LOW;
+}
+
+void digitalWrite(uint8_t, uint8_t) {}
+void pinMode(uint8_t, uint8_t) {}
+
+void delay(unsigned long ms) {
+  if (busy_ns - frame_busy_ns > stats.frame_peak) {
+    stats.frame_peak = busy_ns - frame_busy_ns;
+  }
+  frame_busy_ns = busy_ns;
+  frame_number++;
+  advance((uint64_t) ms * 1000000);
+}
+
+// short waits keep the sketch from anything else, so they count as busy
+void delayMicroseconds(unsigned int us) {
+  work((uint64_t) us * 1000);
+}
+
+unsigned long millis() {
+  return now_ns / 1000000;
+}
+
+unsigned long micros() {
+  return now_ns / 1000;
+}
+
+// ---------------------------------------------------------------- Print
+
+size_t Print::print(const char *s) {
+  size_t n = 0;
+  while (*s) {
+    n += write((uint8_t) *s++);
+  }
+  return n;
+}
+
+size_t Print::print(const __FlashStringHelper *s) {
+  return print(reinterpret_cast<const char *>(s));
+}
+
+size_t Print::print(char c) {
+  return write((uint8_t) c);
+}
+
+static size_t print_number(Print *p, unsigned long long n, int base, bool negative) {
+  char buf[72];
+  char *s = buf + sizeof(buf) - 1;
+  *s = '\0';
+  if (base < 2) {
+    base = 10;
+  }
+  do {
+    int digit = n % base;
+    *--s = digit < 10 ? '0' + digit : 'A' + digit - 10;
+    n /= base;
+  } while (n > 0);
+  if (negative) {
+    *--s = '-';
+  }
+  return p->print(s);
+}
+
+size_t Print::print(long n, int base) {
+  if (base == 10 && n < 0) {
+    return print_number(this, -(long long) n, 10, true);
+  }
+  return print_number(this, (unsigned long) n, base, false);
+}
+
+size_t Print::print(int n, int base) { return print((long) n, base); }
+size_t Print::print(unsigned int n, int base) { return print_number(this, n, base, false); }
+size_t Print::print(unsigned long n, int base) { return print_number(this, n, base, false); }
+
+size_t Print::print(double n, int digits) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%.*f", digits, n);
+  return print(buf);
+}
+
+size_t Print::println() { return print("\r\n"); }
+size_t Print::println(const __FlashStringHelper *s) { return print(s) + println(); }
+size_t Print::println(const char *s) { return print(s) + println(); }
+size_t Print::println(char c) { return print(c) + println(); }
+size_t Print::println(int n, int base) { return print(n, base) + println(); }
+size_t Print::println(unsigned int n, int base) { return print(n, base) + println(); }
+size_t Print::println(long n, int base) { return print(n, base) + println(); }
+size_t Print::println(unsigned long n, int base) { return print(n, base) + println(); }
+size_t Print::println(double n, int digits) { return print(n, digits) + println(); }
+
+void HardwareSerial::begin(unsigned long) {}
+void HardwareSerial::end() {}
+/* Serial input comes from the trace's S lines, each available whole from
+ * its time on; the receive buffer is assumed never to overflow.
+ */
+int HardwareSerial::available() {
+  if (serial_line == serial_in.size() || serial_in[serial_line].ms > trace_ms()) {
+    return 0;
+  }
+  return serial_in[serial_line].text.size() - serial_char;
+}
+
+int HardwareSerial::read() {
+  if (available() == 0) {
+    return -1;
+  }
+  int c = (unsigned char) serial_in[serial_line].text[serial_char++];
+  if (serial_char == serial_in[serial_line].text.size()) {
+    serial_line++;
+    serial_char = 0;
+  }
+  return c;
+}
+
+/* Characters drain at the baud rate; the sketch only waits once the
+ * transmit buffer is full.
+ */
+size_t HardwareSerial::write(uint8_t c) {
+  if (verbose) {
+    fputc(c, stderr);
+  }
+  serial_drain_ns = max(serial_drain_ns, now_ns) + COST_SERIAL_CHAR;
+  uint64_t buffered = (uint64_t) SERIAL_TX_BUFFER * COST_SERIAL_CHAR;
+  if (serial_drain_ns > now_ns + buffered) {
+    work(serial_drain_ns - buffered - now_ns);
+  }
+  return 1;
+}
+
+// ---------------------------------------------------------------- display
+
+static uint16_t screen[SCREEN_HEIGHT][SCREEN_WIDTH];
+
+// window set by setAddrWindow() and where pushColors() writes next
+static int16_t win_x0, win_y0, win_x1, win_y1;
+static int32_t win_next;
+
+// the frame each pixel was last written in
+static uint32_t written[SCREEN_HEIGHT][SCREEN_WIDTH];
+
+// false while drawing what the real display would not draw twice
+static bool count_overdraw = true;
+
+static void put_pixel(int16_t x, int16_t y, uint16_t colour) {
+  if (x >= 0 && x < SCREEN_WIDTH && y >= 0 && y < SCREEN_HEIGHT) {
+    screen[y][x] = colour;
+    if (written[y][x] == frame_number) {
+      stats.overdraw += count_overdraw;
+    }
+    written[y][x] = frame_number;
+  }
+}
+
+static void fill(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t colour) {
+  work(COST_WINDOW);
+  if (w <= 0 || h <= 0) {
+    return;
+  }
+  stats.pixels += (uint64_t) w * h;
+  work((uint64_t) w * h * COST_PIXEL_FILL);
+  for (int16_t j = y; j < y + h; j++) {
+    for (int16_t i = x; i < x + w; i++) {
+      put_pixel(i, j, colour);
+    }
+  }
+}
+
+Adafruit_GFX::Adafruit_GFX()
+  : cursor_x(0), cursor_y(0), textcolor(0xFFFF), textbgcolor(0xFFFF),
+    textsize(1), wrap(true) {}
+
+void Adafruit_GFX::startWrite() {}
+void Adafruit_GFX::endWrite() {}
+
+// each call the sketch makes is one draw_op, however it is drawn
+void Adafruit_GFX::drawPixel(int16_t x, int16_t y, uint16_t colour) {
+  stats.draw_ops++;
+  fill(x, y, 1, 1, colour);
+}
+
+void Adafruit_GFX::drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t colour) {
+  stats.draw_ops++;
+  fill(x, y, w, 1, colour);
+}
+
+void Adafruit_GFX::drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t colour) {
+  stats.draw_ops++;
+  fill(x, y, 1, h, colour);
+}
+
+void Adafruit_GFX::fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t colour) {
+  probe_stack();
+  stats.draw_ops++;
+  fill(x, y, w, h, colour);
+}
+
+void Adafruit_GFX::drawRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t colour) {
+  stats.draw_ops++;
+  fill(x, y, w, 1, colour);
+  fill(x, y + h - 1, w, 1, colour);
+  fill(x, y, 1, h, colour);
+  fill(x + w - 1, y, 1, h, colour);
+}
+
+void Adafruit_GFX::fillScreen(uint16_t colour) {
+  stats.draw_ops++;
+  fill(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, colour);
+}
+
+// drawn as vertical lines like the GFX library does
+void Adafruit_GFX::fillCircle(int16_t x0, int16_t y0, int16_t r, uint16_t colour) {
+  probe_stack();
+  stats.draw_ops++;
+  for (int16_t dx = -r; dx <= r; dx++) {
+    int16_t dy = (int16_t) sqrt((double) (r * r - dx * dx));
+    fill(x0 + dx, y0 - dy, 1, 2 * dy + 1, colour);
+  }
+}
+
+void Adafruit_GFX::drawCircle(int16_t x0, int16_t y0, int16_t r, uint16_t colour) {
+  stats.draw_ops++;
+  for (int16_t dx = -r; dx <= r; dx++) {
+    int16_t dy = (int16_t) sqrt((double) (r * r - dx * dx));
+    fill(x0 + dx, y0 - dy, 1, 1, colour);
+    fill(x0 + dx, y0 + dy, 1, 1, colour);
+  }
+}
+
+void Adafruit_GFX::setCursor(int16_t x, int16_t y) {
+  cursor_x = x;
+  cursor_y = y;
+}
+
+void Adafruit_GFX::setTextColor(uint16_t c) {
+  textcolor = textbgcolor = c;
+}
+
+void Adafruit_GFX::setTextColor(uint16_t c, uint16_t bg) {
+  textcolor = c;
+  textbgcolor = bg;
+}
+
+void Adafruit_GFX::setTextSize(uint8_t s) {
+  textsize = s > 0 ? s : 1;
+}
+
+void Adafruit_GFX::setTextWrap(bool w) {
+  wrap = w;
+}
+
+void Adafruit_GFX::setRotation(uint8_t) {}
+
+int16_t Adafruit_GFX::width() const { return SCREEN_WIDTH; }
+int16_t Adafruit_GFX::height() const { return SCREEN_HEIGHT; }
+
+/* Characters are 6x8 cells of the built in font.  The glyphs themselves
+ * are not simulated: the cell gets the background, if there is one, and a
+ * bar of the text colour, which is enough to see the text on a screenshot.
+ * The GFX library draws each font pixel as its own rectangle, so that is
+ * what is charged.
+ */
+size_t Adafruit_GFX::write(uint8_t c) {
+  int16_t s = textsize;
+  if (c == '\n') {
+    cursor_x = 0;
+    cursor_y += 8 * s;
+    return 1;
+  }
+  if (c == '\r') {
+    return 1;
+  }
+  stats.draw_ops++;
+  if (wrap && cursor_x + 6 * s > SCREEN_WIDTH) {
+    cursor_x = 0;
+    cursor_y += 8 * s;
+  }
+  if (textbgcolor != textcolor) {
+    for (int16_t j = 0; j < 8; j++) {
+      for (int16_t i = 0; i < 6; i++) {
+        fill(cursor_x + i * s, cursor_y + j * s, s, s, textbgcolor);
+      }
+    }
+  }
+  if (c != ' ') {
+    // the real glyph pixels are each drawn once, in one colour or the
+    // other, so the bar over the background is not overdraw
+    count_overdraw = textbgcolor == textcolor;
+    for (int16_t j = 1; j < 7; j++) {
+      for (int16_t i = 0; i < 5; i += 2) {
+        fill(cursor_x + i * s, cursor_y + j * s, s, s, textcolor);
+      }
+    }
+    count_overdraw = true;
+  }
+  cursor_x += 6 * s;
+  return 1;
+}
+
+uint16_t MCUFRIEND_kbv::readID() { return 0x9341; }
+void MCUFRIEND_kbv::begin(uint16_t) {}
+
+void MCUFRIEND_kbv::setAddrWindow(int16_t x, int16_t y, int16_t x1, int16_t y1) {
+  stats.draw_ops++;
+  work(COST_WINDOW);
+  win_x0 = x;
+  win_y0 = y;
+  win_x1 = x1;
+  win_y1 = y1;
+  win_next = 0;
+}
+
+void MCUFRIEND_kbv::pushColors(uint16_t *block, int16_t n, bool first) {
+  probe_stack();
+  if (first) {
+    win_next = 0;
+  }
+  int32_t w = win_x1 - win_x0 + 1;
+  for (int16_t i = 0; i < n; i++, win_next++) {
+    put_pixel(win_x0 + win_next % w, win_y0 + win_next / w, block[i]);
+  }
+  stats.pixels += n;
+  work((uint64_t) n * COST_PIXEL_PUSH);
+}
+
+// ---------------------------------------------------------------- touch
+
+TouchScreen::TouchScreen(uint8_t, uint8_t, uint8_t, uint8_t, uint16_t) {}
+
+/* Taps wait to be seen: the oldest tap that has started and not yet been
+ * reported is returned, even if the sketch was busy for its whole interval.
+ */
+TSPoint TouchScreen::getPoint() {
+  advance(3 * COST_ANALOG_READ);
+  Sample &now = current_sample();
+  TSPoint p;
+  for (Sample *s = &trace[0]; s <= &now; s++) {
+    if (s->tz > 0 && !s->tapped) {
+      s->tapped = true;
+      p.x = s->tx;
+      p.y = s->ty;
+      p.z = s->tz;
+      break;
+    }
+  }
+  return p;
+}
+
+// ---------------------------------------------------------------- SD card
+
+struct CardFile {
+  vector<uint8_t> data;
+};
+
+struct OpenFile {
+  CardFile *file;
+  uint32_t pos;
+};
+
+static string card_dir = "card";
+static std::map<string, CardFile *> card_files;
+static vector<OpenFile> open_files;
+static vector<uint8_t> rest_blocks;
+
+// the SD library caches a single block, shared by all open files
+static const CardFile *cached_file = NULL;
+static uint32_t cached_block = 0;
+
+static CardFile *load_file(const char *name) {
+  std::map<string, CardFile *>::iterator it = card_files.find(name);
+  if (it != card_files.end()) {
+    return it->second;
+  }
+  ifstream in((card_dir + "/" + name).c_str(), ios::binary);
+  if (!in) {
+    return NULL;
+  }
+  CardFile *f = new CardFile;
+  f->data.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+  card_files[name] = f;
+  return f;
+}
+
+bool SDClass::begin(uint8_t) {
+  spi_rate = SPI_HALF_SPEED;
+  const char *dir = getenv("SIM_CARD");
+  if (dir != NULL) {
+    card_dir = dir;
+  }
+  return true;
+}
+
+bool SDClass::exists(const char *path) {
+  return load_file(path) != NULL;
+}
+
+File SDClass::open(const char *path, uint8_t) {
+  probe_stack();
+  work(COST_SD_OPEN);
+  stats.sd_opens++;
+  File f;
+  CardFile *cf = load_file(path);
+  if (cf == NULL) {
+    return f;
+  }
+  OpenFile of = { cf, 0 };
+  for (size_t i = 0; i < open_files.size(); i++) {
+    if (open_files[i].file == NULL) {
+      open_files[i] = of;
+      f.handle = i;
+      return f;
+    }
+  }
+  open_files.push_back(of);
+  f.handle = open_files.size() - 1;
+  return f;
+}
+
+File::File() : handle(-1) {}
+
+File::operator bool() const {
+  return handle >= 0;
+}
+
+int File::read(void *buf, uint16_t nbyte) {
+  probe_stack();
+  if (handle < 0) {
+    return -1;
+  }
+  OpenFile &of = open_files[handle];
+  uint32_t avail = of.file->data.size() - min((size_t) of.pos, of.file->data.size());
+  uint32_t n = min((uint32_t) nbyte, avail);
+  if (n == 0) {
+    return 0;
+  }
+
+  for (uint32_t b = of.pos / BLOCK_SIZE; b <= (of.pos + n - 1) / BLOCK_SIZE; b++) {
+    if (cached_file != of.file || cached_block != b) {
+      stats.sd_blocks++;
+      work(sd_block_cost());
+      if (sd_fault()) {
+        cached_file = NULL;
+        return -1;
+      }
+      cached_file = of.file;
+      cached_block = b;
+    }
+  }
+  memcpy(buf, &of.file->data[of.pos], n);
+  of.pos += n;
+  stats.sd_bytes += n;
+  return n;
+}
+
+int File::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int File::available() {
+  if (handle < 0) {
+    return 0;
+  }
+  OpenFile &of = open_files[handle];
+  return of.file->data.size() - min((size_t) of.pos, of.file->data.size());
+}
+
+bool File::seek(uint32_t pos) {
+  if (handle < 0) {
+    return false;
+  }
+  work(COST_SD_SEEK);
+  stats.sd_seeks++;
+  open_files[handle].pos = pos;
+  return pos <= open_files[handle].file->data.size();
+}
+
+uint32_t File::position() {
+  return handle < 0 ? 0 : open_files[handle].pos;
+}
+
+uint32_t File::size() {
+  return handle < 0 ? 0 : open_files[handle].file->data.size();
+}
+
+void File::close() {
+  if (handle >= 0) {
+    open_files[handle].file = NULL;
+    handle = -1;
+  }
+}
+
+bool Sd2Card::init(uint8_t sckRateID, uint8_t) {
+  spi_rate = sckRateID;
+  const char *dir = getenv("SIM_CARD");
+  const char *file = getenv("SIM_RESTAURANTS");
+  string path = string(dir != NULL ? dir : "card") + "/"
+    + (file != NULL ? file : "restaurants.bin");
+  ifstream in(path.c_str(), ios::binary);
+  if (!in) {
+    fprintf(stderr, "sim: no raw block image %s\n", path.c_str());
+    return false;
+  }
+  rest_blocks.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+  return true;
+}
+
+/* Raw reads bypass the SD library's block cache. */
+bool Sd2Card::readBlock(uint32_t block, uint8_t *dst) {
+  probe_stack();
+  work(sd_block_cost());
+  stats.sd_blocks++;
+  if (sd_fault()) {
+    return false;
+  }
+  stats.sd_bytes += BLOCK_SIZE;
+  memset(dst, 0, BLOCK_SIZE);
+  if (block >= REST_START_BLOCK) {
+    size_t off = (size_t) (block - REST_START_BLOCK) * BLOCK_SIZE;
+    if (off < rest_blocks.size()) {
+      memcpy(dst, &rest_blocks[off], min((size_t) BLOCK_SIZE, rest_blocks.size() - off));
+    }
+  }
+  return true;
+}
+
+// ---------------------------------------------------------------- report
+
+static void write_screen(const char *path) {
+  FILE *f = fopen(path, "wb");
+  if (f == NULL) {
+    fprintf(stderr, "sim: cannot write %s\n", path);
+    return;
+  }
+  fprintf(f, "P6\n%d %d\n255\n", SCREEN_WIDTH, SCREEN_HEIGHT);
+  for (int y = 0; y < SCREEN_HEIGHT; y++) {
+    for (int x = 0; x < SCREEN_WIDTH; x++) {
+      uint16_t c = screen[y][x];
+      fputc((c >> 11) << 3, f);
+      fputc(((c >> 5) & 0x3F) << 2, f);
+      fputc((c & 0x1F) << 3, f);
+    }
+  }
+  fclose(f);
+}
+
+static void finish() {
+  printf("time_ms %llu\n", (unsigned long long) (now_ns / 1000000));
+  printf("busy_ms %llu\n", (unsigned long long) (busy_ns / 1000000));
+  printf("sd_bytes %llu\n", (unsigned long long) stats.sd_bytes);
+  printf("sd_blocks %llu\n", (unsigned long long) stats.sd_blocks);
+  printf("sd_seeks %llu\n", (unsigned long long) stats.sd_seeks);
+  printf("sd_opens %llu\n", (unsigned long long) stats.sd_opens);
+  printf("pixels %llu\n", (unsigned long long) stats.pixels);
+  printf("draw_ops %llu\n", (unsigned long long) stats.draw_ops);
+  printf("overdraw %llu\n", (unsigned long long) stats.overdraw);
+  printf("frame_peak_ms %llu\n", (unsigned long long) (stats.frame_peak / 1000000));
+  printf("sd_errors %llu\n", (unsigned long long) stats.sd_errors);
+  printf("stack_peak %llu\n", (unsigned long long) stats.stack_peak);
+  printf("scratch_peak %u\n", (unsigned) scratch_peak());
+  fflush(stdout);
+  if (screen_path != NULL) {
+    write_screen(screen_path);
+  }
+  exit(0);
+}
@@ -0,0 +1,245 @@
+/*
+ * Host tool for converting .lcd map images between the layouts that
+ * lcd_image_draw() understands.  Build with `make -C tools`.
+ *
+ * Usage:
+ *   lcdconv tile <in.lcd> <out.lct> <ncols> <nrows>
+ *       rewrites a row-major image as LCD_TILE_SIZE x LCD_TILE_SIZE tiles
+ *   lcdconv rle <in.lcd> <out.lcr> <ncols> <nrows>
+ *       writes the tiles run-length encoded (LCD_TILED_RLE) and reports the
+ *       compression ratio
+ *   lcdconv shrink <in.lcd> <out.lcd> <ncols> <nrows>
+ *       writes a row-major copy at half the width and height, each pixel the
+ *       average of a 2x2 block, for the zoomed out levels of the map
+ *   lcdconv thumb <in.lcd> <out.lcd> <ncols> <nrows> <size>
+ *       writes a row-major size x size thumbnail, each pixel the average of
+ *       the block of the image it covers, for the minimap in the sidebar
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// must match lcd_image.h
+#define LCD_TILE_SIZE 16
+
+using namespace std;
+
+/* A whole image held in memory, pixels kept in the byte order of the card. */
+struct Image {
+  uint16_t ncols, nrows;
+  vector<uint16_t> pixels;
+
+  uint16_t &at(int col, int row) { return pixels[(size_t) row * ncols + col]; }
+};
+
+static bool readImage(const char *path, uint16_t ncols, uint16_t nrows, Image &img) {
+  img.ncols = ncols;
+  img.nrows = nrows;
+  img.pixels.assign((size_t) ncols * nrows, 0);
+
+  ifstream in(path, ios::binary);
+  size_t bytes = img.pixels.size() * 2;
+  if (!in.read((char *) img.pixels.data(), bytes)) {
+    cerr << path << ": expected " << bytes << " bytes of pixels" << endl;
+    return false;
+  }
+  return true;
+}
+
+static bool writeBytes(const char *path, const void *data, size_t bytes) {
+  ofstream out(path, ios::binary);
+  if (!out.write((const char *) data, bytes)) {
+    cerr << path << ": write failed" << endl;
+    return false;
+  }
+  return true;
+}
+
+/* Reorders a row-major image into tiles, tile rows top to bottom. */
+static int tile(const char *inPath, const char *outPath, uint16_t ncols, uint16_t nrows) {
+  if (ncols % LCD_TILE_SIZE || nrows % LCD_TILE_SIZE) {
+    cerr << "image size must be a multiple of " << LCD_TILE_SIZE << endl;
+    return 1;
+  }
+  Image img;
+  if (!readImage(inPath, ncols, nrows, img)) {
+    return 1;
+  }
+
+  vector<uint16_t> tiled;
+  tiled.reserve(img.pixels.size());
+  for (int ty = 0; ty < nrows; ty += LCD_TILE_SIZE) {
+    for (int tx = 0; tx < ncols; tx += LCD_TILE_SIZE) {
+      for (int y = ty; y < ty + LCD_TILE_SIZE; y++) {
+        for (int x = tx; x < tx + LCD_TILE_SIZE; x++) {
+          tiled.push_back(img.at(x, y));
+        }
+      }
+    }
+  }
+  return writeBytes(outPath, tiled.data(), tiled.size() * 2) ? 0 : 1;
+}
+
+/* Writes the LCD_TILED_RLE form of a row-major image: the tile offset
+ * table followed by every tile's runs.
+ */
+static int rle(const char *inPath, const char *outPath, uint16_t ncols, uint16_t nrows) {
+  if (ncols % LCD_TILE_SIZE || nrows % LCD_TILE_SIZE) {
+    cerr << "image size must be a multiple of " << LCD_TILE_SIZE << endl;
+    return 1;
+  }
+  Image img;
+  if (!readImage(inPath, ncols, nrows, img)) {
+    return 1;
+  }
+
+  size_t ntiles = (size_t) (ncols / LCD_TILE_SIZE) * (nrows / LCD_TILE_SIZE);
+  vector<uint32_t> offsets;
+  vector<uint8_t> runs;
+  size_t uniform = 0;
+  for (int ty = 0; ty < nrows; ty += LCD_TILE_SIZE) {
+    for (int tx = 0; tx < ncols; tx += LCD_TILE_SIZE) {
+      offsets.push_back((ntiles + 1) * sizeof(uint32_t) + runs.size());
+      size_t start = runs.size();
+
+      int count = 0;
+      uint16_t pixel = 0;
+      for (int y = ty; y < ty + LCD_TILE_SIZE; y++) {
+        for (int x = tx; x < tx + LCD_TILE_SIZE; x++) {
+          if (count > 0 && img.at(x, y) != pixel) {
+            runs.push_back(count - 1);
+            runs.insert(runs.end(), (uint8_t *) &pixel, (uint8_t *) &pixel + 2);
+            count = 0;
+          }
+          pixel = img.at(x, y);
+          count++;
+        }
+      }
+      runs.push_back(count - 1);
+      runs.insert(runs.end(), (uint8_t *) &pixel, (uint8_t *) &pixel + 2);
+
+      if (runs.size() - start == 3) {
+        uniform++;
+      }
+    }
+  }
+  offsets.push_back((ntiles + 1) * sizeof(uint32_t) + runs.size());
+
+  vector<uint8_t> out((uint8_t *) offsets.data(),
+                      (uint8_t *) (offsets.data() + offsets.size()));
+  out.insert(out.end(), runs.begin(), runs.end());
+  if (!writeBytes(outPath, out.data(), out.size())) {
+    return 1;
+  }
+
+  size_t raw = img.pixels.size() * 2;
+  printf("%zu -> %zu bytes, ratio %.2f:1, %zu of %zu tiles uniform\n",
+         raw, out.size(), (double) raw / out.size(), uniform, ntiles);
+  return 0;
+}
+
+/* Pixels are stored most significant byte first, so swap to get RGB565. */
+static uint16_t toRGB(uint16_t stored) {
+  return (stored << 8) | (stored >> 8);
+}
+
+static int shrink(const char *inPath, const char *outPath, uint16_t ncols, uint16_t nrows) {
+  if (ncols % 2 || nrows % 2) {
+    cerr << "image size must be even" << endl;
+    return 1;
+  }
+  Image img;
+  if (!readImage(inPath, ncols, nrows, img)) {
+    return 1;
+  }
+
+  vector<uint16_t> half;
+  half.reserve(img.pixels.size() / 4);
+  for (int y = 0; y < nrows; y += 2) {
+    for (int x = 0; x < ncols; x += 2) {
+      uint16_t quad[4] = { img.at(x, y), img.at(x + 1, y),
+                           img.at(x, y + 1), img.at(x + 1, y + 1) };
+      int r = 0, g = 0, b = 0;
+      for (uint16_t stored : quad) {
+        uint16_t rgb = toRGB(stored);
+        r += rgb >> 11;
+        g += (rgb >> 5) & 0x3F;
+        b += rgb & 0x1F;
+      }
+      // round to nearest so flat areas stay exactly the same colour
+      uint16_t rgb = ((r + 2) / 4) << 11 | ((g + 2) / 4) << 5 | (b + 2) / 4;
+      half.push_back(toRGB(rgb));
+    }
+  }
+  return writeBytes(outPath, half.data(), half.size() * 2) ? 0 : 1;
+}
+
+static int thumb(const char *inPath, const char *outPath, uint16_t ncols, uint16_t nrows,
+                 uint16_t size) {
+  if (size == 0 || size > ncols || size > nrows) {
+    cerr << "thumbnail size must be from 1 to the image size" << endl;
+    return 1;
+  }
+  Image img;
+  if (!readImage(inPath, ncols, nrows, img)) {
+    return 1;
+  }
+
+  // the blocks differ by a pixel where the image does not divide evenly
+  vector<uint16_t> small;
+  small.reserve((size_t) size * size);
+  for (int ty = 0; ty < size; ty++) {
+    int y0 = ty * nrows / size, y1 = (ty + 1) * nrows / size;
+    for (int tx = 0; tx < size; tx++) {
+      int x0 = tx * ncols / size, x1 = (tx + 1) * ncols / size;
+      long r = 0, g = 0, b = 0, n = 0;
+      for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+          uint16_t rgb = toRGB(img.at(x, y));
+          r += rgb >> 11;
+          g += (rgb >> 5) & 0x3F;
+          b += rgb & 0x1F;
+          n++;
+        }
+      }
+      uint16_t rgb = ((r + n/2) / n) << 11 | ((g + n/2) / n) << 5 | (b + n/2) / n;
+      small.push_back(toRGB(rgb));
+    }
+  }
+  return writeBytes(outPath, small.data(), small.size() * 2) ? 0 : 1;
+}
+
+static void usage() {
+  cerr << "usage: lcdconv tile <in.lcd> <out.lct> <ncols> <nrows>" << endl;
+  cerr << "       lcdconv rle <in.lcd> <out.lcr> <ncols> <nrows>" << endl;
+  cerr << "       lcdconv shrink <in.lcd> <out.lcd> <ncols> <nrows>" << endl;
+  cerr << "       lcdconv thumb <in.lcd> <out.lcd> <ncols> <nrows> <size>" << endl;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    usage();
+    return 1;
+  }
+  string cmd = argv[1];
+  if (cmd == "tile" && argc == 6) {
+    return tile(argv[2], argv[3], atoi(argv[4]), atoi(argv[5]));
+  }
+  if (cmd == "rle" && argc == 6) {
+    return rle(argv[2], argv[3], atoi(argv[4]), atoi(argv[5]));
+  }
+  if (cmd == "shrink" && argc == 6) {
+    return shrink(argv[2], argv[3], atoi(argv[4]), atoi(argv[5]));
+  }
+  if (cmd == "thumb" && argc == 7) {
+    return thumb(argv[2], argv[3], atoi(argv[4]), atoi(argv[5]), atoi(argv[6]));
+  }
+  usage();
+  return 1;
+}
@@ -0,0 +1,110 @@
+/*
+ * Host tool that builds names.idx, the sorted index of restaurant names
+ * the sketch's search mode looks names up in, from a dump of the
+ * restaurant blocks on the SD card.  Copy names.idx to the card next to
+ * the map images.  Build with `make -C tools`.
+ *
+ * Usage:
+ *   nameindex <restaurants.bin> <names.idx>
+ *
+ * The index is a two level tree of 512 byte blocks, so a lookup reads
+ * two blocks, three if its matches run into the next leaf:
+ *   block 0     uint16 entry count, uint16 leaf count, then the key of the
+ *               first entry of each leaf
+ *   blocks 1..  leaves of up to NAME_LEAF_ENTRIES entries, each a key and
+ *               the uint16 index of the restaurant on the card
+ * A key is the first NAME_KEY_LEN characters of the name in upper case,
+ * padded with zeros; entries are sorted by key, then by index.  Numbers
+ * are little-endian.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+// must match main.cpp
+#define NUM_RESTAURANTS 1066
+#define NAME_KEY_LEN 14
+#define NAME_ENTRY_SIZE 16
+#define NAME_LEAF_ENTRIES 32
+#define NAME_HEADER_SIZE 4
+
+// bytes of one struct Restaurant on the card, and where its name starts
+#define RECORD_SIZE 64
+#define NAME_OFFSET 9
+#define NAME_SIZE 55
+
+#define BLOCK_SIZE 512
+
+using namespace std;
+
+struct Entry {
+  char key[NAME_KEY_LEN];
+  uint16_t index;
+
+  bool operator<(const Entry &other) const {
+    int c = memcmp(key, other.key, NAME_KEY_LEN);
+    return c != 0 ? c < 0 : index < other.index;
+  }
+};
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    cerr << "usage: nameindex <restaurants.bin> <names.idx>" << endl;
+    return 2;
+  }
+
+  ifstream in(argv[1], ios::binary);
+  vector<uint8_t> data(NUM_RESTAURANTS * RECORD_SIZE);
+  if (!in.read((char *) data.data(), data.size())) {
+    cerr << "nameindex: " << argv[1] << " holds fewer than "
+         << NUM_RESTAURANTS << " restaurants" << endl;
+    return 1;
+  }
+
+  vector<Entry> entries(NUM_RESTAURANTS);
+  for (int i = 0; i < NUM_RESTAURANTS; i++) {
+    const char *name = (const char *) &data[i * RECORD_SIZE + NAME_OFFSET];
+    Entry &e = entries[i];
+    memset(e.key, 0, NAME_KEY_LEN);
+    for (int k = 0; k < NAME_KEY_LEN && k < NAME_SIZE && name[k] != '\0'; k++) {
+      e.key[k] = toupper((unsigned char) name[k]);
+    }
+    e.index = i;
+  }
+  sort(entries.begin(), entries.end());
+
+  int leaves = (NUM_RESTAURANTS + NAME_LEAF_ENTRIES - 1) / NAME_LEAF_ENTRIES;
+  if (NAME_HEADER_SIZE + leaves * NAME_KEY_LEN > BLOCK_SIZE) {
+    cerr << "nameindex: " << leaves << " leaves do not fit in the header" << endl;
+    return 1;
+  }
+
+  vector<uint8_t> out((1 + leaves) * BLOCK_SIZE, 0);
+  out[0] = NUM_RESTAURANTS & 0xFF;
+  out[1] = NUM_RESTAURANTS >> 8;
+  out[2] = leaves & 0xFF;
+  out[3] = leaves >> 8;
+  for (int i = 0; i < NUM_RESTAURANTS; i++) {
+    int leaf = i / NAME_LEAF_ENTRIES;
+    uint8_t *p = &out[(1 + leaf) * BLOCK_SIZE + (i % NAME_LEAF_ENTRIES) * NAME_ENTRY_SIZE];
+    memcpy(p, entries[i].key, NAME_KEY_LEN);
+    p[NAME_KEY_LEN] = entries[i].index & 0xFF;
+    p[NAME_KEY_LEN + 1] = entries[i].index >> 8;
+    if (i % NAME_LEAF_ENTRIES == 0) {
+      memcpy(&out[NAME_HEADER_SIZE + leaf * NAME_KEY_LEN], entries[i].key, NAME_KEY_LEN);
+    }
+  }
+
+  ofstream o(argv[2], ios::binary);
+  if (!o.write((const char *) out.data(), out.size())) {
+    cerr << "nameindex: cannot write " << argv[2] << endl;
+    return 1;
+  }
+  cout << NUM_RESTAURANTS << " names in " << leaves << " leaves" << endl;
+  return 0;
+}
@@ -0,0 +1,253 @@
+/*
+ * Host tool that finds the nearest restaurants to every point of a file,
+ * the answer the sketch's nearest list would give with the cursor there,
+ * with RestBatch spreading the points over a pool of threads.  Build with
+ * `make -C tools`.
+ *
+ * Usage:
+ *   rankbatch [-t threads] [-k count] [-d policy] <restaurants.bin> <points> [<answers>]
+ *       restaurants.bin holds the raw blocks from REST_START_BLOCK on.
+ *       points has one point per line, "x y" on the full size map, each
+ *       fitting in 16 bits, and optionally the lowest rating wanted; "-"
+ *       reads standard input.
+ *       answers, standard output unless given, gets one line per point
+ *       in the same order: the point, then index:distance of the count
+ *       nearest restaurants (21 by default), nearest first.  policy is
+ *       manhattan (the default, as the sketch), euclidean or equirect
+ *       from distance.h.  threads defaults to the number of CPUs.
+ *
+ *   rankbatch -b [-t threads] [-k count] [-d policy] <restaurants.bin> [<step>]
+ *       benchmark: answers a point every step pixels (2 by default) over
+ *       the whole map with 1, 2, 4... threads up to threads, printing the
+ *       rate and the speedup over one thread, and checks every run gives
+ *       the same answers
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "restbatch.h"
+
+// must match main.cpp
+#define NUM_RESTAURANTS 1066
+#define NEAREST_COUNT 21
+
+// bytes of one struct Restaurant on the card
+#define RECORD_SIZE 64
+
+using namespace std;
+
+struct Options {
+  int threads;
+  int k;
+  bool bench;
+};
+
+static int32_t readInt32(const uint8_t *p) {
+  return (int32_t) ((uint32_t) p[0] | (uint32_t) p[1] << 8 |
+                    (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24);
+}
+
+static bool readRestaurants(const char *path, RestIndex &index) {
+  ifstream in(path, ios::binary);
+  vector<uint8_t> data(NUM_RESTAURANTS * RECORD_SIZE);
+  if (!in.read((char *) data.data(), data.size())) {
+    cerr << "rankbatch: " << path << " holds fewer than " << NUM_RESTAURANTS
+         << " restaurants" << endl;
+    return false;
+  }
+  for (int i = 0; i < NUM_RESTAURANTS; i++) {
+    const uint8_t *r = &data[i * RECORD_SIZE];
+    RestPos pos = {lon_to_x(readInt32(r + 4)), lat_to_y(readInt32(r)), r[8]};
+    index.add(pos);
+  }
+  return true;
+}
+
+static bool readPoints(const char *path, vector<RestQuery> &queries) {
+  FILE *in = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+  if (in == NULL) {
+    cerr << "rankbatch: cannot read " << path << endl;
+    return false;
+  }
+  char line[64];
+  for (int n = 1; fgets(line, sizeof(line), in) != NULL; n++) {
+    int x, y, rating = 0;
+    int fields = sscanf(line, "%d %d %d", &x, &y, &rating);
+    if (fields < 2) {
+      cerr << "rankbatch: " << path << ":" << n << ": expected x y [rating]"
+           << endl;
+      return false;
+    }
+    if (x < INT16_MIN || x > INT16_MAX || y < INT16_MIN || y > INT16_MAX) {
+      cerr << "rankbatch: " << path << ":" << n << ": x and y must be "
+           << INT16_MIN << " to " << INT16_MAX << endl;
+      return false;
+    }
+    if (rating < 0 || rating > UINT8_MAX) {
+      cerr << "rankbatch: " << path << ":" << n << ": rating must be 0 to "
+           << UINT8_MAX << endl;
+      return false;
+    }
+    RestQuery query = {(int16_t) x, (int16_t) y, (uint8_t) rating};
+    queries.push_back(query);
+  }
+  if (in != stdin) {
+    fclose(in);
+  }
+  return true;
+}
+
+/* Appends one line of answers: the point, then index:distance of each
+ * restaurant found.
+ */
+template <class Metric>
+static void formatAnswer(const RestQuery &query,
+                         const RankedRest<Metric, uint32_t> *top, int count,
+                         string &out) {
+  char buf[24];
+  out.append(buf, snprintf(buf, sizeof(buf), "%d %d", query.x, query.y));
+  for (int i = 0; i < count; i++) {
+    out.append(buf, snprintf(buf, sizeof(buf), " %u:%lu",
+                             (unsigned) top[i].index,
+                             (unsigned long) top[i].dist));
+  }
+  out += '\n';
+}
+
+/* Answers every query into out.
+ */
+template <class Metric>
+static void answer(const RestIndex &index, const vector<RestQuery> &queries,
+                   const Options &options, FILE *out) {
+  RestBatch<Metric> batch(index, options.k, options.threads);
+  batch.run(queries, formatAnswer<Metric>, [out](const string &text) {
+    fwrite(text.data(), 1, text.size(), out);
+  });
+}
+
+/* Answers the queries with more and more threads, printing the rates.
+ */
+template <class Metric>
+static bool bench(const RestIndex &index, const vector<RestQuery> &queries,
+                  const Options &options) {
+  cout << queries.size() << " points, " << index.size() << " restaurants, k = "
+       << options.k << ", " << Metric::name() << ", "
+       << thread::hardware_concurrency() << " CPUs" << endl;
+  printf("%8s %12s %8s %8s\n", "threads", "points/s", "speedup", "steals");
+  double base = 0;
+  uint64_t first = 0;
+  for (int threads = 1; threads == 1 || threads <= options.threads;
+       threads *= 2) {
+    RestBatch<Metric> batch(index, options.k, threads);
+    // a checksum of the answers in order, so a run that gets an answer
+    // or the order wrong shows up
+    uint64_t sum = 0;
+    auto start = chrono::steady_clock::now();
+    batch.run(queries, formatAnswer<Metric>, [&sum](const string &text) {
+      for (size_t i = 0; i < text.size(); i++) {
+        sum = sum * 31 + (uint8_t) text[i];
+      }
+    });
+    chrono::duration<double> time = chrono::steady_clock::now() - start;
+    double rate = queries.size() / time.count();
+    if (threads == 1) {
+      base = rate;
+      first = sum;
+    }
+    else if (sum != first) {
+      cerr << "rankbatch: " << threads << " threads gave other answers" << endl;
+      return false;
+    }
+    printf("%8d %12.0f %7.2fx %8zu\n", threads, rate, rate / base,
+           batch.steals());
+  }
+  return true;
+}
+
+template <class Metric>
+static int run(const RestIndex &index, char **args, int nargs,
+               const Options &options) {
+  vector<RestQuery> queries;
+  if (options.bench) {
+    int step = nargs > 1 ? atoi(args[1]) : 2;
+    if (step < 1) {
+      cerr << "rankbatch: step must be at least 1" << endl;
+      return 2;
+    }
+    for (int y = 0; y < MAP_HEIGHT; y += step) {
+      for (int x = 0; x < MAP_WIDTH; x += step) {
+        RestQuery query = {(int16_t) x, (int16_t) y, 0};
+        queries.push_back(query);
+      }
+    }
+    return bench<Metric>(index, queries, options) ? 0 : 1;
+  }
+
+  if (!readPoints(args[1], queries)) {
+    return 1;
+  }
+  FILE *out = nargs > 2 ? fopen(args[2], "w") : stdout;
+  if (out == NULL) {
+    cerr << "rankbatch: cannot write " << args[2] << endl;
+    return 1;
+  }
+  answer<Metric>(index, queries, options, out);
+  return fclose(out) == 0 ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+  Options options = {max((int) thread::hardware_concurrency(), 1),
+                     NEAREST_COUNT, false};
+  const char *policy = "manhattan";
+  int arg = 1;
+  for (; arg < argc && argv[arg][0] == '-' && argv[arg][1] != '\0'; arg++) {
+    if (strcmp(argv[arg], "-b") == 0) {
+      options.bench = true;
+    }
+    else if (strcmp(argv[arg], "-t") == 0 && arg + 1 < argc) {
+      options.threads = atoi(argv[++arg]);
+    }
+    else if (strcmp(argv[arg], "-k") == 0 && arg + 1 < argc) {
+      options.k = atoi(argv[++arg]);
+    }
+    else if (strcmp(argv[arg], "-d") == 0 && arg + 1 < argc) {
+      policy = argv[++arg];
+    }
+    else {
+      arg = argc;
+    }
+  }
+  int nargs = argc - arg;
+  if (nargs < 1 || (!options.bench && nargs < 2) || nargs > 3
+      || options.k < 0) {
+    cerr << "usage: rankbatch [-t threads] [-k count] [-d policy] "
+            "<restaurants.bin> <points> [<answers>]\n"
+            "       rankbatch -b [-t threads] [-k count] [-d policy] "
+            "<restaurants.bin> [<step>]" << endl;
+    return 2;
+  }
+
+  RestIndex index;
+  if (!readRestaurants(argv[arg], index)) {
+    return 1;
+  }
+  if (strcmp(policy, ManhattanDistance::name()) == 0) {
+    return run<ManhattanDistance>(index, argv + arg, nargs, options);
+  }
+  if (strcmp(policy, EuclideanDistance::name()) == 0) {
+    return run<EuclideanDistance>(index, argv + arg, nargs, options);
+  }
+  if (strcmp(policy, EquirectDistance::name()) == 0) {
+    return run<EquirectDistance>(index, argv + arg, nargs, options);
+  }
+  cerr << "rankbatch: no distance policy " << policy << endl;
+  return 2;
+}
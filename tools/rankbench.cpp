@@ -0,0 +1,129 @@
+/*
+ * Host benchmark of nearest restaurant ranking with the RestIndex of
+ * restfind.h, in queries per second for 1k to 1M restaurants, with the
+ * scalar and the AVX2 distance kernels.  Every answer of the kernels is
+ * checked against rest_rank_nearest(), the ranking the sketch runs.
+ * Build with `make -C tools`.
+ *
+ * Usage:
+ *   rankbench
+ *       the restaurants and query points are spread at random over the
+ *       map, the same on every run
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "restfind.h"
+
+// restaurants in the nearest list, as in the sketch
+#define NEAREST_COUNT 21
+
+// roughly how many distances each timed run works out
+#define WORK_PER_RUN 200000000l
+
+using namespace std;
+
+typedef RankedRest<ManhattanDistance, uint32_t> Ranked;
+
+struct Query {
+  int16_t x, y;
+  uint8_t min_rating;
+};
+
+/* Runs every query and returns the rate they were answered at.  Adds up
+ * the answers into check so the work cannot be left out.
+ */
+static double run(const RestIndex &index, const vector<Query> &queries,
+                  uint64_t &check) {
+  Ranked top[NEAREST_COUNT];
+  auto start = chrono::steady_clock::now();
+  for (size_t q = 0; q < queries.size(); q++) {
+    int count = index.nearest<ManhattanDistance>(
+        queries[q].x, queries[q].y, queries[q].min_rating, top, NEAREST_COUNT);
+    for (int i = 0; i < count; i++) {
+      check += top[i].index;
+    }
+  }
+  chrono::duration<double> time = chrono::steady_clock::now() - start;
+  return queries.size() / time.count();
+}
+
+/* True if both kernels give the answer of rest_rank_nearest() for the
+ * first few queries.
+ */
+static bool agrees(RestIndex &index, const vector<Query> &queries) {
+  auto get_pos = [&](int i, RestPos *pos) { index.get_pos(i, pos); };
+  for (size_t q = 0; q < queries.size() && q < 100; q++) {
+    const Query &query = queries[q];
+    Ranked want[NEAREST_COUNT], got[NEAREST_COUNT];
+    int n = rest_rank_nearest(get_pos, index.size(), query.x, query.y,
+                              query.min_rating, want, NEAREST_COUNT);
+    for (int simd = 0; simd < 2; simd++) {
+      index.use_simd(simd);
+      int count = index.nearest<ManhattanDistance>(
+          query.x, query.y, query.min_rating, got, NEAREST_COUNT);
+      if (count != n) {
+        return false;
+      }
+      for (int i = 0; i < n; i++) {
+        if (got[i].index != want[i].index || got[i].dist != want[i].dist) {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+int main() {
+  mt19937 random(275);
+  // restaurants spill a little past the map edges, as on the card
+  uniform_int_distribution<int> coord(-64, MAP_WIDTH + 64);
+  uniform_int_distribution<int> rating(0, 10);
+  uniform_int_distribution<int> min_rating(0, 4);
+
+  cout << "AVX2 kernel: " << (rest_have_avx2() ? "yes" : "not on this CPU")
+       << endl;
+  printf("%12s %10s %14s %14s %8s\n", "restaurants", "queries", "scalar q/s",
+         "avx2 q/s", "speedup");
+  uint64_t check = 0;
+  for (long n = 1000; n <= 1000000; n *= 10) {
+    RestIndex index;
+    for (long i = 0; i < n; i++) {
+      RestPos pos = {(int16_t) coord(random), (int16_t) coord(random),
+                     (uint8_t) rating(random)};
+      index.add(pos);
+    }
+    vector<Query> queries(WORK_PER_RUN / n);
+    for (size_t q = 0; q < queries.size(); q++) {
+      queries[q].x = coord(random);
+      queries[q].y = coord(random);
+      queries[q].min_rating = min_rating(random);
+    }
+
+    if (!agrees(index, queries)) {
+      cerr << "rankbench: the kernels disagree with " << n << " restaurants"
+           << endl;
+      return 1;
+    }
+    index.use_simd(false);
+    double scalar = run(index, queries, check);
+    index.use_simd(true);
+    if (index.simd()) {
+      double simd = run(index, queries, check);
+      printf("%12ld %10zu %14.0f %14.0f %7.2fx\n", n, queries.size(), scalar,
+             simd, simd / scalar);
+    }
+    else {
+      printf("%12ld %10zu %14.0f %14s %8s\n", n, queries.size(), scalar, "-",
+             "-");
+    }
+  }
+  cerr << "(check " << check << ")" << endl;
+  return 0;
+}
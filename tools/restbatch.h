@@ -0,0 +1,213 @@
+/*
+ * Nearest restaurant answers for many query points at once, on the host.
+ * The queries are cut into chunks shared out among a pool of threads
+ * ranking against one read-only RestIndex; a thread that runs out of
+ * chunks steals from the others, so a slow thread does not hold up the
+ * rest.  The answers come back in query order as the chunks finish, and
+ * the threads take no chunk more than REST_BATCH_AHEAD chunks a thread
+ * past the next one to be written, so a slow writer holds the ranking
+ * back rather than letting answers pile up in memory.
+ */
+
+#ifndef _RESTBATCH_H
+#define _RESTBATCH_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "restfind.h"
+
+// queries ranked by a thread before it looks for more work
+#define REST_BATCH_CHUNK 512
+
+// chunks a thread may be ahead of the writer
+#define REST_BATCH_AHEAD 4
+
+/* A point to find the nearest restaurants to, and the lowest rating
+ * wanted.
+ */
+struct RestQuery {
+  int16_t x, y;
+  uint8_t min_rating;
+};
+
+template <class Metric>
+class RestBatch {
+ public:
+  typedef RankedRest<Metric, uint32_t> Ranked;
+
+  /* Called in a worker thread with the answer to one query, to append it
+   * to the text of its chunk.
+   */
+  typedef std::function<void(const RestQuery &query, const Ranked *top,
+                             int count, std::string &out)> Format;
+
+  /* Called in the thread that started the batch with the text of each
+   * chunk, in query order.
+   */
+  typedef std::function<void(const std::string &text)> Write;
+
+  RestBatch(const RestIndex &index, int k, int threads)
+      : index_(index), k_(k), threads_(threads < 1 ? 1 : threads) {}
+
+  /* Answers every query, returning once the last chunk is written.
+   */
+  void run(const std::vector<RestQuery> &queries, Format format, Write write) {
+    size_t chunks = (queries.size() + REST_BATCH_CHUNK - 1) / REST_BATCH_CHUNK;
+    std::vector<Chunk> done(chunks);
+    // the chunks are dealt out in turn, so the threads move through the
+    // queries together and usually about one chunk a thread waits to be
+    // written; each takes its own from the front, thieves from the back
+    std::vector<std::unique_ptr<Queue> > queues;
+    for (int t = 0; t < threads_; t++) {
+      queues.emplace_back(new Queue);
+    }
+    for (size_t c = 0; c < chunks; c++) {
+      queues[c % threads_]->chunks.push_back(c);
+    }
+    steals_ = 0;
+    written_ = 0;
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads_; t++) {
+      workers.emplace_back([&, t]() {
+        std::vector<Ranked> top(k_);
+        size_t c;
+        while (next_chunk(queues, t, c)) {
+          size_t end = std::min(queries.size(), (c + 1) * REST_BATCH_CHUNK);
+          for (size_t q = c * REST_BATCH_CHUNK; q < end; q++) {
+            int count = index_.nearest<Metric>(queries[q].x, queries[q].y,
+                                               queries[q].min_rating,
+                                               top.data(), k_);
+            format(queries[q], top.data(), count, done[c].text);
+          }
+          std::lock_guard<std::mutex> lock(done_mutex_);
+          done[c].ready = true;
+          done_cv_.notify_one();
+        }
+      });
+    }
+
+    // stream the chunks out in order, freeing each once written
+    for (size_t c = 0; c < chunks; c++) {
+      {
+        std::unique_lock<std::mutex> lock(done_mutex_);
+        done_cv_.wait(lock, [&]() { return done[c].ready; });
+      }
+      write(done[c].text);
+      std::string().swap(done[c].text);
+      {
+        std::lock_guard<std::mutex> lock(done_mutex_);
+        written_ = c + 1;
+      }
+      window_cv_.notify_all();
+    }
+    for (size_t t = 0; t < workers.size(); t++) {
+      workers[t].join();
+    }
+  }
+
+  /* Chunks taken from another thread's queue in the last run().
+   */
+  size_t steals() const { return steals_; }
+
+ private:
+  struct Chunk {
+    Chunk() : ready(false) {}
+    std::string text;
+    bool ready;
+  };
+
+  struct Queue {
+    std::mutex mutex;
+    std::deque<size_t> chunks;
+  };
+
+  enum Take { TAKEN, WAIT, NONE };
+
+  /* Takes the next chunk of thread t's own queue, or steals the last of
+   * another's, or the first when the last is too far ahead.  False once
+   * there is no work left anywhere; waits for the writer while every
+   * chunk left is too far ahead of it.
+   */
+  bool next_chunk(std::vector<std::unique_ptr<Queue> > &queues, int t,
+                  size_t &c) {
+    size_t window = (size_t) threads_ * REST_BATCH_AHEAD;
+    while (true) {
+      size_t limit;
+      {
+        std::lock_guard<std::mutex> lock(done_mutex_);
+        limit = written_ + window;
+      }
+      Take take = take_chunk(queues, t, limit, c);
+      if (take != WAIT) {
+        return take == TAKEN;
+      }
+      // the chunk the writer waits for is never too far ahead, so some
+      // thread can always take it
+      std::unique_lock<std::mutex> lock(done_mutex_);
+      window_cv_.wait(lock, [&]() { return written_ + window > limit; });
+    }
+  }
+
+  /* One look through the queues for a chunk before limit.
+   */
+  Take take_chunk(std::vector<std::unique_ptr<Queue> > &queues, int t,
+                  size_t limit, size_t &c) {
+    Take take = NONE;
+    {
+      std::lock_guard<std::mutex> lock(queues[t]->mutex);
+      std::deque<size_t> &own = queues[t]->chunks;
+      if (!own.empty()) {
+        if (own.front() < limit) {
+          c = own.front();
+          own.pop_front();
+          return TAKEN;
+        }
+        take = WAIT;
+      }
+    }
+    for (int i = 1; i < threads_; i++) {
+      Queue &victim = *queues[(t + i) % threads_];
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      std::deque<size_t> &chunks = victim.chunks;
+      if (chunks.empty()) {
+        continue;
+      }
+      if (chunks.back() < limit) {
+        c = chunks.back();
+        chunks.pop_back();
+      } else if (chunks.front() < limit) {
+        c = chunks.front();
+        chunks.pop_front();
+      } else {
+        take = WAIT;
+        continue;
+      }
+      steals_++;
+      return TAKEN;
+    }
+    return take;
+  }
+
+  const RestIndex &index_;
+  int k_;
+  int threads_;
+  std::mutex done_mutex_;
+  std::condition_variable done_cv_;
+  // chunks written so far in the current run(), and the workers waiting
+  // for it to grow
+  size_t written_;
+  std::condition_variable window_cv_;
+  std::atomic<size_t> steals_;
+};
+
+#endif
@@ -0,0 +1,133 @@
+/*
+ * Host tool that turns a dump of the restaurant blocks on the SD card into
+ * rest_table.h, the table of restaurant map positions and ratings the
+ * sketch keeps in flash when built with -DREST_TABLE, with indices of the
+ * restaurants by rating and by map grid cell.  Build with
+ * `make -C tools`.
+ *
+ * Usage:
+ *   restgen <restaurants.bin> <rest_table.h>
+ *       restaurants.bin holds the raw blocks from REST_START_BLOCK on, e.g.
+ *       dd if=/dev/sdX of=restaurants.bin bs=512 skip=4000000 count=134
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "restfind.h"
+
+// must match main.cpp
+#define NUM_RESTAURANTS 1066
+#define MAX_RATING 10
+
+// the grid index splits the map into REST_GRID_SIZE x REST_GRID_SIZE cells
+// of (1 << REST_GRID_SHIFT) pixels square
+#define REST_GRID_SHIFT 7
+#define REST_GRID_SIZE (MAP_WIDTH >> REST_GRID_SHIFT)
+
+// bytes of one struct Restaurant on the card
+#define RECORD_SIZE 64
+
+using namespace std;
+
+static int32_t readInt32(const uint8_t *p) {
+  return (int32_t) ((uint32_t) p[0] | (uint32_t) p[1] << 8 |
+                    (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24);
+}
+
+/* Writes n buckets of restaurant indices as two flash arrays: the
+ * indices, bucket after bucket, and where each bucket starts in them.
+ */
+static void writeBuckets(FILE *out, const char *startName, const char *listName,
+                         const vector<int> *buckets, int n) {
+  fprintf(out, "const uint16_t %s[%d] PROGMEM = {", startName, n + 1);
+  int start = 0;
+  for (int b = 0; b < n; b++) {
+    fprintf(out, "%s%d,", b % 12 == 0 ? "\n  " : " ", start);
+    start += buckets[b].size();
+  }
+  fprintf(out, " %d\n};\n\n", start);
+
+  fprintf(out, "const uint16_t %s[REST_TABLE_COUNT] PROGMEM = {", listName);
+  int k = 0;
+  for (int b = 0; b < n; b++) {
+    for (size_t i = 0; i < buckets[b].size(); i++, k++) {
+      fprintf(out, "%s%d,", k % 12 == 0 ? "\n  " : " ", buckets[b][i]);
+    }
+  }
+  fprintf(out, "\n};\n");
+}
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    cerr << "usage: restgen <restaurants.bin> <rest_table.h>" << endl;
+    return 2;
+  }
+
+  ifstream in(argv[1], ios::binary);
+  vector<uint8_t> data(NUM_RESTAURANTS * RECORD_SIZE);
+  if (!in.read((char *) data.data(), data.size())) {
+    cerr << "restgen: " << argv[1] << " holds fewer than "
+         << NUM_RESTAURANTS << " restaurants" << endl;
+    return 1;
+  }
+
+  FILE *out = fopen(argv[2], "w");
+  if (out == NULL) {
+    cerr << "restgen: cannot write " << argv[2] << endl;
+    return 1;
+  }
+  fprintf(out, "/*\n * Generated by tools/restgen from %s, do not edit.\n"
+          " * Map positions and ratings of the restaurants, in card order.\n"
+          " */\n\n", argv[1]);
+  fprintf(out, "#define REST_TABLE_COUNT %d\n\n", NUM_RESTAURANTS);
+  fprintf(out, "const RestPos restTable[REST_TABLE_COUNT] PROGMEM = {\n");
+  vector<int> cells[REST_GRID_SIZE * REST_GRID_SIZE];
+  for (int i = 0; i < NUM_RESTAURANTS; i++) {
+    const uint8_t *r = &data[i * RECORD_SIZE];
+    int32_t lat = readInt32(r);
+    int32_t lon = readInt32(r + 4);
+    // as the sketch computes them
+    int16_t x = lon_to_x(lon);
+    int16_t y = lat_to_y(lat);
+    fprintf(out, "  {%d, %d, %d},\n", x, y, r[8]);
+
+    // restaurants off the map go in the nearest cell on it
+    int cx = min(max(x >> REST_GRID_SHIFT, 0), REST_GRID_SIZE - 1);
+    int cy = min(max(y >> REST_GRID_SHIFT, 0), REST_GRID_SIZE - 1);
+    cells[cy * REST_GRID_SIZE + cx].push_back(i);
+  }
+  fprintf(out, "};\n\n");
+
+  fprintf(out, "// restaurants in grid cell (cx, cy) are restByCell[cellStart[c]] up to\n"
+          "// restByCell[cellStart[c+1]-1], c = cy * REST_GRID_SIZE + cx\n");
+  fprintf(out, "#define REST_GRID_SHIFT %d\n", REST_GRID_SHIFT);
+  fprintf(out, "#define REST_GRID_SIZE %d\n\n", REST_GRID_SIZE);
+  writeBuckets(out, "cellStart", "restByCell", cells, REST_GRID_SIZE * REST_GRID_SIZE);
+
+  // bucket the restaurants by rating, each bucket in card order
+  vector<int> buckets[MAX_RATING + 1];
+  for (int i = 0; i < NUM_RESTAURANTS; i++) {
+    int rating = data[i * RECORD_SIZE + 8];
+    if (rating > MAX_RATING) {
+      cerr << "restgen: restaurant " << i << " is rated " << rating << endl;
+      return 1;
+    }
+    buckets[rating].push_back(i);
+  }
+
+  fprintf(out, "\n// restaurants rated r are restByRating[ratingStart[r]] up to\n"
+          "// restByRating[ratingStart[r+1]-1]\n");
+  writeBuckets(out, "ratingStart", "restByRating", buckets, MAX_RATING + 1);
+  fclose(out);
+
+  cout << NUM_RESTAURANTS << " restaurants, "
+       << NUM_RESTAURANTS * 9 + 2 * (MAX_RATING + 2)
+          + 2 * (REST_GRID_SIZE * REST_GRID_SIZE + 1) << " bytes of flash"
+       << endl;
+  return 0;
+}
@@ -0,0 +1,107 @@
+/*
+ * Host tool that reorders a dump of the restaurant blocks on the SD card
+ * along a Z-order (Morton) curve over map position, so that restaurants
+ * near each other on the map share blocks on the card.  The nearest
+ * restaurants to a point then come from a few blocks rather than nearly
+ * one block each.  Build with `make -C tools`.
+ *
+ * Usage:
+ *   restsort <in.bin> <out.bin> <out.map>
+ *       in.bin and out.bin hold the raw blocks from REST_START_BLOCK on;
+ *       out.map gets one line per restaurant of out.bin, giving the index
+ *       it had in in.bin, for anything still keyed by the old indices.
+ *       Write out.bin back to the card with
+ *       dd if=out.bin of=/dev/sdX bs=512 seek=4000000
+ *       and regenerate rest_table.h from it.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+#include "restfind.h"
+
+// must match main.cpp
+#define NUM_RESTAURANTS 1066
+
+// bytes of one struct Restaurant on the card
+#define RECORD_SIZE 64
+
+using namespace std;
+
+static int32_t readInt32(const uint8_t *p) {
+  return (int32_t) ((uint32_t) p[0] | (uint32_t) p[1] << 8 |
+                    (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24);
+}
+
+// spreads the low 16 bits of v out to the even bits of the result
+static uint32_t spreadBits(uint32_t v) {
+  v &= 0xFFFF;
+  v = (v | (v << 8)) & 0x00FF00FF;
+  v = (v | (v << 4)) & 0x0F0F0F0F;
+  v = (v | (v << 2)) & 0x33333333;
+  v = (v | (v << 1)) & 0x55555555;
+  return v;
+}
+
+/* Position of a restaurant along the Z-order curve; restaurants off the
+ * map are placed at the nearest map edge.
+ */
+static uint32_t mortonCode(const uint8_t *record) {
+  int32_t lat = readInt32(record);
+  int32_t lon = readInt32(record + 4);
+  int32_t x = rest_map(lon, LON_WEST, LON_EAST, 0, MAP_WIDTH);
+  int32_t y = rest_map(lat, LAT_NORTH, LAT_SOUTH, 0, MAP_HEIGHT);
+  x = min(max(x, (int32_t) 0), (int32_t) MAP_WIDTH - 1);
+  y = min(max(y, (int32_t) 0), (int32_t) MAP_HEIGHT - 1);
+  return spreadBits(x) | (spreadBits(y) << 1);
+}
+
+int main(int argc, char **argv) {
+  if (argc != 4) {
+    cerr << "usage: restsort <in.bin> <out.bin> <out.map>" << endl;
+    return 2;
+  }
+
+  ifstream in(argv[1], ios::binary);
+  vector<uint8_t> data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+  if (data.size() < NUM_RESTAURANTS * RECORD_SIZE) {
+    cerr << "restsort: " << argv[1] << " holds fewer than "
+         << NUM_RESTAURANTS << " restaurants" << endl;
+    return 1;
+  }
+
+  vector<int> order(NUM_RESTAURANTS);
+  vector<uint32_t> code(NUM_RESTAURANTS);
+  for (int i = 0; i < NUM_RESTAURANTS; i++) {
+    order[i] = i;
+    code[i] = mortonCode(&data[i * RECORD_SIZE]);
+  }
+  // stable, so restaurants at the same position keep their relative order
+  stable_sort(order.begin(), order.end(),
+              [&](int a, int b) { return code[a] < code[b]; });
+
+  // anything after the last record, such as the rest of its block, is kept
+  vector<uint8_t> sorted(data);
+  for (int i = 0; i < NUM_RESTAURANTS; i++) {
+    copy(&data[order[i] * RECORD_SIZE], &data[(order[i] + 1) * RECORD_SIZE],
+         &sorted[i * RECORD_SIZE]);
+  }
+
+  ofstream out(argv[2], ios::binary);
+  out.write((const char *) sorted.data(), sorted.size());
+  FILE *map = fopen(argv[3], "w");
+  if (!out || map == NULL) {
+    cerr << "restsort: cannot write " << argv[2] << " and " << argv[3] << endl;
+    return 1;
+  }
+  for (int i = 0; i < NUM_RESTAURANTS; i++) {
+    fprintf(map, "%d\n", order[i]);
+  }
+  fclose(map);
+  return 0;
+}